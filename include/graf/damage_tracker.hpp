@@ -0,0 +1,87 @@
+/**************************************************************************************************
+ * graf library                                                                                   *
+ * Copyright © 2012 David Kretzmer                                                                *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction,including without limitation the rights to use, copy, modify, merge, publish,      *
+ * distribute,sublicense, and/or sell copies of the Software, and to permit persons to whom the   *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#pragma once
+
+#include <graf/graf.hpp>
+
+#include <vector>
+
+
+namespace graf
+{
+	//=============================================================================================
+	// An axis-aligned rectangle in window coordinates, the origin being the top-left corner
+	//=============================================================================================
+	struct screen_rect
+	{
+		int x, y;
+		int width, height;
+	};
+
+
+	//=============================================================================================
+	// Collects the areas of the window that have changed, so only these have to be redrawn. The
+	// damage of the last few frames is kept, because with double buffering the back buffer
+	// usually contains an older frame than the last one (see window::buffer_age()).
+	//=============================================================================================
+	class damage_tracker
+	{
+	public:
+		// Constructor. The whole window is considered damaged in the first frame.
+		damage_tracker(uint width, uint height);
+
+		// Adds a damaged area to the current frame
+		void add(float x, float y, float width, float height);
+
+		// Marks the whole window as damaged, e.g. after it has been exposed or resized
+		void add_all();
+
+		// Changes the window size and marks the whole window as damaged
+		void resize(uint width, uint height);
+
+		// Returns whether nothing has been damaged in the current frame
+		bool empty() const { return m_frames[0].empty(); }
+
+		// Returns the areas that have to be redrawn if the back buffer contains the frame from
+		// buffer_age frames ago. A buffer age of 0 means that its content is unknown. If nothing
+		// has been damaged in the current frame, nothing has to be redrawn.
+		::std::vector<screen_rect> const& regions(uint buffer_age);
+
+		// Finishes the current frame and starts a new one
+		void next_frame();
+
+	private:
+		// Number of frames whose damage is kept
+		static uint const max_age = 4;
+		// If a frame has more damaged areas, all of them are merged into one
+		static size_t const max_rects = 8;
+
+		uint m_width, m_height;
+		::std::vector<screen_rect> m_frames[max_age];
+		// The number of frames that are valid in m_frames
+		uint m_num_frames;
+		::std::vector<screen_rect> m_regions;
+
+		static void merge(::std::vector<screen_rect> &rects, screen_rect rect);
+	};
+
+} // namespace: graf
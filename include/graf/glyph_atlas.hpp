@@ -0,0 +1,129 @@
+/**************************************************************************************************
+ * graf library                                                                                   *
+ * Copyright © 2012 David Kretzmer                                                                *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction,including without limitation the rights to use, copy, modify, merge, publish,      *
+ * distribute,sublicense, and/or sell copies of the Software, and to permit persons to whom the   *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#pragma once
+
+#include <graf/graf.hpp>
+#include <graf/opengl.hpp>
+#include <graf/shelf_packer.hpp>
+
+#include <unordered_map>
+#include <vector>
+
+
+namespace graf
+{
+	//=============================================================================================
+	// A rasterized glyph. Coordinates are in pixels with the y-axis pointing down.
+	//=============================================================================================
+	struct glyph_bitmap
+	{
+		uint width, height;
+		// Offset of the bitmap's top-left corner from the pen position on the baseline
+		int left, top;
+		// How far the pen moves after this glyph
+		float advance;
+		// width * height coverage values, row by row, starting with the top row
+		::std::vector<GLubyte> coverage;
+	};
+
+
+	//=============================================================================================
+	// The interface to a font library. Implement it for the library of your choice (FreeType,
+	// SFML...).
+	//=============================================================================================
+	class font
+	{
+	public:
+		virtual ~font() {}
+
+		// Rasterizes the glyph of the given code point at the given size
+		virtual void rasterize(uint code_point, uint pixel_size, glyph_bitmap &glyph) = 0;
+
+		// Distance from the top of a line to its baseline
+		virtual float ascent(uint pixel_size) = 0;
+
+		// Distance between the baselines of two lines
+		virtual float line_height(uint pixel_size) = 0;
+	};
+
+
+	//=============================================================================================
+	// Packs glyphs into a single texture. Glyphs are rasterized once at base_size and stored as
+	// signed distance fields, so the same texture serves text of any size. Glyphs are rasterized
+	// and uploaded the first time they are requested.
+	//=============================================================================================
+	class glyph_atlas
+	{
+	public:
+		typedef uint font_id;
+
+		// A glyph in the atlas. Positions and sizes are in texels. The texture area includes the
+		// spread on every side.
+		struct glyph
+		{
+			GLushort texture_position[2];
+			GLushort texture_size[2];
+			// Offset of the texture area from the pen position, in texels
+			float left, top;
+			float advance;
+		};
+
+		// Constructor. Creates a texture of size x size texels. Distances up to spread texels
+		// from a glyph's outline are stored.
+		glyph_atlas(uint size = 1024, uint base_size = 32, uint spread = 4);
+
+		// Destructor
+		~glyph_atlas();
+
+		// Adds a font. The atlas does not take ownership.
+		font_id add_font(font *f);
+
+		// Returns the glyph of the given code point, adding it to the atlas if necessary.
+		// Throws an exception if the atlas is full.
+		glyph const& get(font_id font, uint code_point);
+
+		// Returns the distance between two baselines for the given font scaled to pixel_size
+		float line_height(font_id font, float pixel_size) const;
+		float ascent(font_id font, float pixel_size) const;
+
+		GLuint texture() const { return m_texture; }
+		uint base_size() const { return m_base_size; }
+		uint spread() const { return m_spread; }
+
+	private:
+		GLuint m_texture;
+		uint m_size;
+		uint m_base_size;
+		uint m_spread;
+
+		::std::vector<font*> m_fonts;
+		// Key: (font << 32) | code point
+		::std::unordered_map<unsigned long long, glyph> m_glyphs;
+
+		shelf_packer m_packer;
+		glyph_bitmap m_bitmap;
+		::std::vector<GLubyte> m_distances;
+
+		void compute_distances();
+	};
+
+} // namespace: graf
@@ -42,6 +42,9 @@ namespace internal
 		// Destructor
 		~opengl_device_impl();
 
+		// Binds the context to the window on the calling thread
+		void make_current();
+
 	private:
 		window_impl *m_window;
 		::GLXContext m_context;
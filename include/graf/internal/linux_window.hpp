@@ -35,6 +35,8 @@
 
 namespace graf
 {
+	struct screen_rect;
+
 namespace internal
 {
 	//=============================================================================================
@@ -143,14 +145,31 @@ namespace internal
 		// Returns false if the user has closed the window.
 		bool process_events();
 
+		// Like process_events(), but sleeps until at least one event has arrived
+		bool wait_events();
+
+		// Returns true if the window has received an Expose event since the last call
+		bool exposed();
+
 		// Get screen dimension
 		uint screen_width() const { return m_screen.width(); }
 		uint screen_height() const { return m_screen.height(); }
 
+		// Get window dimension
+		uint width() const { return m_width; }
+		uint height() const { return m_height; }
+
 		// Swaps the backbuffer with the frontbuffer, so all your work becomes
 		// visible.
 		void swap_buffers();
 
+		// Makes the given regions of the backbuffer visible. Uses GLX_MESA_copy_sub_buffer if the
+		// buffer age is unknown, so the backbuffer keeps its content.
+		void swap_buffers(screen_rect const *regions, size_t num);
+
+		// Returns how many frames old the content of the backbuffer is, or 0 if it is undefined
+		uint buffer_age();
+
 
 		::Display* display() { return m_screen.display(); }
 		int screen() { return m_screen.screen(); }
@@ -163,8 +182,17 @@ namespace internal
 		// The window resource ID
 		Window m_window;
 		Atom m_atom_delete_window;
+		bool m_exposed;
 
 		GLXFBConfig m_fb_config;
+
+		// GLX_EXT_buffer_age
+		bool m_has_buffer_age;
+		// GLX_MESA_copy_sub_buffer
+		typedef void (*glXCopySubBufferMESAProc)(::Display*, ::GLXDrawable, int, int, int, int);
+		glXCopySubBufferMESAProc m_copy_sub_buffer;
+		// Size of the window, kept up to date by process_events()
+		uint m_width, m_height;
 	};
 
 } // namespace: internal
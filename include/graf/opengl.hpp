@@ -24,6 +24,8 @@
 #include <graf/graf.hpp>
 
 #include <memory>
+#include <string>
+#include <vector>
 
 #define GL3_PROTOTYPES
 #include <GL3/gl3.h>
@@ -47,8 +49,17 @@ namespace graf
 		// Releases the context.
 		~opengl_device();
 
+		// Returns whether the given extension (e.g. "GL_KHR_parallel_shader_compile") is
+		// supported by the context.
+		bool has_extension(char const *name) const;
+
+		// Makes the context current on the calling thread again, e.g. after another library
+		// has bound its own context.
+		void make_current();
+
 	private:
 		::std::unique_ptr<internal::opengl_device_impl> m_impl;
+		::std::vector< ::std::string > m_extensions;
 	};
 
 
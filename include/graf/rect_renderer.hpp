@@ -0,0 +1,190 @@
+/**************************************************************************************************
+ * graf library                                                                                   *
+ * Copyright © 2012 David Kretzmer                                                                *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction,including without limitation the rights to use, copy, modify, merge, publish,      *
+ * distribute,sublicense, and/or sell copies of the Software, and to permit persons to whom the   *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#pragma once
+
+#include <graf/graf.hpp>
+#include <graf/shader.hpp>
+#include <graf/damage_tracker.hpp>
+
+#include <vector>
+
+
+namespace graf
+{
+	//=============================================================================================
+	// A colour with 8 bits per channel
+	//=============================================================================================
+	struct color
+	{
+		GLubyte r, g, b, a;
+	};
+
+
+	//=============================================================================================
+	// An area in pixels that a rectangle is clipped to. An empty clip rect disables clipping.
+	//=============================================================================================
+	struct clip_rect
+	{
+		GLushort position[2];
+		GLushort size[2];
+	};
+
+
+	//=============================================================================================
+	// What a rectangle is filled with
+	//=============================================================================================
+	enum rect_kind
+	{
+		rect_solid = 0, // Fill and outline colour
+		rect_glyph = 1, // A glyph from the glyph texture, drawn in the fill colour
+		rect_image = 2  // An area of the image texture, multiplied by the fill colour
+	};
+
+
+	//=============================================================================================
+	// The per-instance data of a rectangle. The layout is uploaded to the GPU as it is, so keep
+	// it small.
+	//=============================================================================================
+	struct rect_instance
+	{
+		GLfloat position[2];      // Top-left corner in pixels
+		GLfloat size[2];          // Width and height in pixels
+		color fill;
+		color outline;
+		GLfloat outline_thickness; // The outline is drawn outside of the rectangle
+		GLfloat corner_radius;     // Radius of the rectangle's corners, the outline follows them
+		GLuint z_index;            // Rectangles with a higher z-index are drawn on top
+		GLushort texture_position[2]; // Top-left corner of the texture area in texels
+		GLushort texture_size[2];     // Size of the texture area in texels
+		GLuint kind;                  // See rect_kind
+		clip_rect clip;               // Parts outside of it are not drawn, including the outline
+	};
+
+
+	//=============================================================================================
+	// Draws rectangles using instancing. Rectangles are retained: each one owns a persistent slot
+	// in the instance buffer and only rectangles that have actually changed since the last frame
+	// are uploaded again, merged into as few contiguous ranges as possible. All rectangles are
+	// drawn with two draw calls, one for the opaque and one for the translucent ones.
+	//=============================================================================================
+	class rect_renderer
+	{
+	public:
+		typedef uint rect_id;
+
+		// Constructor. The shader program is queued on the given shader manager, so
+		// shader_manager::submit() has to be called afterwards.
+		rect_renderer(shader_manager &shaders);
+
+		// Destructor
+		~rect_renderer();
+
+		// Adds a rectangle and returns its ID, which stays valid until the rectangle is removed
+		rect_id add(rect_instance const &rect);
+
+		// Changes the given rectangle. If the new values are equal to the old ones this is a
+		// no-op, so it is fine to call it for every rectangle every frame.
+		void change(rect_id id, rect_instance const &rect);
+
+		// Returns the given rectangle
+		rect_instance const& get(rect_id id) const;
+
+		// Removes the given rectangle
+		void remove(rect_id id);
+
+		// Reports the old and the new area of every added, changed or removed rectangle to the
+		// given damage tracker. Pass nullptr to stop tracking.
+		void track_damage(damage_tracker *tracker) { m_damage = tracker; }
+
+		// Sets the texture rect_glyph rectangles are taken from. It must contain a signed
+		// distance field in the red channel that maps the distances [-spread, spread] (in
+		// texels) to [0, 1] (see glyph_atlas).
+		void glyph_texture(GLuint texture, uint spread)
+		{
+			m_glyph_texture = texture;
+			m_glyph_spread = spread;
+		}
+
+		// Sets the RGBA texture rect_image rectangles are taken from (see texture_atlas)
+		void image_texture(GLuint texture) { m_image_texture = texture; }
+
+		// Uploads the changed rectangles and draws all of them in the order of their z-index,
+		// using the depth buffer to reject hidden parts of opaque rectangles. Does nothing as long
+		// as the shader program is not ready. To only redraw the damaged regions, call it once per
+		// region with the scissor test enabled; the upload only happens in the first call.
+		void display(uint viewport_width, uint viewport_height);
+
+	private:
+		shader_manager &m_shaders;
+		damage_tracker *m_damage;
+		shader_manager::program_id m_program;
+		GLint m_viewport_location;
+		GLint m_depth_scale_location;
+		GLint m_glyph_spread_location;
+		GLint m_images_location;
+		GLuint m_glyph_texture;
+		uint m_glyph_spread;
+		GLuint m_image_texture;
+
+		GLuint m_vertex_array;
+		GLuint m_instance_buffer;
+		size_t m_buffer_capacity;
+
+		// All rectangles, indexed by ID
+		::std::vector<rect_instance> m_rects;
+		::std::vector<bool> m_used;
+		::std::vector<rect_id> m_free_ids;
+		// The position of each rectangle in the instance buffer
+		::std::vector<uint> m_positions;
+
+		// The IDs in drawing order and a copy of the instance buffer's content. The first
+		// m_opaque_count rectangles are opaque and sorted front-to-back, the rest is sorted
+		// back-to-front.
+		::std::vector<rect_id> m_order;
+		::std::vector<rect_instance> m_sorted;
+		size_t m_opaque_count;
+
+		// Rectangles that have changed since the last upload
+		::std::vector<rect_id> m_dirty;
+		::std::vector<bool> m_is_dirty;
+		// Set if rectangles have been added or removed
+		bool m_ids_changed;
+		// Set if a z-index has changed
+		bool m_order_changed;
+
+		// The (z-index, ID) pairs that are radix sorted to get the drawing order
+		struct sort_key
+		{
+			GLuint z_index;
+			rect_id id;
+		};
+		::std::vector<sort_key> m_keys;
+		::std::vector<sort_key> m_key_buffer;
+
+		void sort();
+		bool in_z_order() const;
+		void bind_instances(size_t first);
+		void add_damage(rect_instance const &rect);
+		void upload();
+	};
+
+} // namespace: graf
@@ -0,0 +1,96 @@
+/**************************************************************************************************
+ * graf library                                                                                   *
+ * Copyright © 2012 David Kretzmer                                                                *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction,including without limitation the rights to use, copy, modify, merge, publish,      *
+ * distribute,sublicense, and/or sell copies of the Software, and to permit persons to whom the   *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#pragma once
+
+#include <graf/graf.hpp>
+#include <graf/opengl.hpp>
+
+#include <string>
+#include <vector>
+
+
+namespace graf
+{
+	//=============================================================================================
+	// Compiles and links shader programs in bulk. Programs are first queued with add() and then
+	// handed to the driver all at once with submit(). If the driver supports
+	// KHR_parallel_shader_compile, compiling and linking happens on driver threads and submit()
+	// returns immediately, so the application can keep rendering (e.g. a loading screen) while
+	// polling the progress with poll(). Without the extension the driver compiles serially and
+	// the first call to poll() blocks until everything is done.
+	//=============================================================================================
+	class shader_manager
+	{
+	public:
+		typedef uint program_id;
+
+		// Constructor
+		shader_manager(opengl_device &device);
+
+		// Deletes all programs
+		~shader_manager();
+
+		// Queues a program consisting of the given vertex and fragment shader. Nothing is
+		// compiled until submit() is called.
+		program_id add(char const *vertex_source, char const *fragment_source);
+
+		// Starts compiling and linking all queued programs.
+		void submit();
+
+		// Returns true if all submitted programs have been linked. Throws an exception if
+		// compiling or linking a program failed.
+		bool poll();
+
+		// Blocks until all submitted programs have been linked.
+		void finish();
+
+		// Returns whether the given program has been linked
+		bool ready(program_id id) const;
+
+		// Returns the OpenGL name of the given program, or 0 if it is not ready yet
+		GLuint program(program_id id) const;
+
+		// Returns whether the driver compiles shaders in parallel
+		bool parallel() const { return m_parallel; }
+
+	private:
+		enum state { queued, linking, linked };
+
+		struct program_entry
+		{
+			::std::string m_vertex_source;
+			::std::string m_fragment_source;
+			GLuint m_vertex_shader;
+			GLuint m_fragment_shader;
+			GLuint m_program;
+			state m_state;
+		};
+
+		::std::vector<program_entry> m_programs;
+		// Number of programs that have been submitted but are not linked yet
+		size_t m_pending;
+		bool m_parallel;
+
+		void complete(program_entry &entry);
+	};
+
+} // namespace: graf
@@ -0,0 +1,75 @@
+/**************************************************************************************************
+ * graf library                                                                                   *
+ * Copyright © 2012 David Kretzmer                                                                *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction,including without limitation the rights to use, copy, modify, merge, publish,      *
+ * distribute,sublicense, and/or sell copies of the Software, and to permit persons to whom the   *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#pragma once
+
+#include <graf/graf.hpp>
+
+#include <vector>
+
+
+namespace graf
+{
+	//=============================================================================================
+	// Packs rectangles into a larger area. Rectangles are placed side by side in rows ("shelves")
+	// whose height is set by the first rectangle. A rectangle goes to the smallest shelf that fits
+	// it without wasting too much height. Shelves can be cleared individually, which makes
+	// evicting rarely used content simple. Empty shelves at the top are merged back into the free
+	// area, so it can be split into shelves of different heights again.
+	//=============================================================================================
+	class shelf_packer
+	{
+	public:
+		// Constructor
+		shelf_packer(uint width, uint height);
+
+		// Finds a free area of the given size and stores its top-left corner in x and y and the
+		// shelf it has been placed on in shelf. Returns false if there is no space left.
+		bool allocate(uint width, uint height, uint *x, uint *y, uint *shelf);
+
+		// Checks whether a rectangle of the given size could be allocated after clearing the
+		// shelves for which reclaimable is true, without changing anything
+		bool could_allocate(uint width, uint height, ::std::vector<bool> const &reclaimable) const;
+
+		// Makes the whole shelf available again. If it is at the top, it is removed together with
+		// the empty shelves below it, so num_shelves() may shrink.
+		void clear_shelf(uint shelf);
+
+		// Makes the whole area available again
+		void clear();
+
+		uint num_shelves() const { return m_shelves.size(); }
+		uint shelf_height(uint shelf) const { return m_shelves[shelf].height; }
+
+	private:
+		struct shelf_data
+		{
+			uint y, height;
+			uint used_width;
+		};
+
+		uint m_width, m_height;
+		::std::vector<shelf_data> m_shelves;
+
+		bool would_be_empty(uint shelf, ::std::vector<bool> const &reclaimable) const;
+	};
+
+} // namespace: graf
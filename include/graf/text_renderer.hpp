@@ -0,0 +1,129 @@
+/**************************************************************************************************
+ * graf library                                                                                   *
+ * Copyright © 2012 David Kretzmer                                                                *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction,including without limitation the rights to use, copy, modify, merge, publish,      *
+ * distribute,sublicense, and/or sell copies of the Software, and to permit persons to whom the   *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#pragma once
+
+#include <graf/graf.hpp>
+#include <graf/rect_renderer.hpp>
+#include <graf/glyph_atlas.hpp>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace graf
+{
+	//=============================================================================================
+	// Draws text by emitting one rect_glyph instance per glyph into a rect_renderer, so text is
+	// drawn in the same draw calls as all other rectangles. Texts are retained like rectangles.
+	// The layout of a text only depends on the string, the font and the size, so it is computed
+	// once and shared by all texts with the same parameters.
+	//=============================================================================================
+	class text_renderer
+	{
+	public:
+		typedef uint text_id;
+
+		// Constructor. Sets the glyph texture of the rect renderer.
+		text_renderer(rect_renderer &rects, glyph_atlas &atlas);
+
+		// Adds a UTF-8 encoded text whose first line's top-left corner is at (x, y)
+		text_id add(char const *text, glyph_atlas::font_id font, float size,
+		            float x, float y, color fill, GLuint z_index);
+
+		// Changes position, colour, z-index and clip rect of the given text. Only glyphs that have
+		// actually changed are uploaded again.
+		void change(text_id id, float x, float y, color fill, GLuint z_index,
+		            clip_rect const &clip = clip_rect());
+
+		// Shows or hides the given text. Hidden texts keep their properties but have no
+		// rectangles in the rect renderer, so they cost nothing to draw.
+		void visible(text_id id, bool visible);
+
+		// Replaces the string of the given text
+		void change_text(text_id id, char const *text);
+
+		// Removes the given text
+		void remove(text_id id);
+
+		// Returns the size of the given text in pixels
+		float width(text_id id) const;
+		float height(text_id id) const;
+
+	private:
+		struct layout_key
+		{
+			::std::string m_text;
+			glyph_atlas::font_id m_font;
+			float m_size;
+
+			bool operator == (layout_key const &rhs) const
+			{
+				return m_font == rhs.m_font && m_size == rhs.m_size && m_text == rhs.m_text;
+			}
+		};
+
+		struct layout_key_hash
+		{
+			size_t operator () (layout_key const &key) const;
+		};
+
+		// The glyphs of a text relative to its top-left corner
+		struct layout
+		{
+			::std::vector<rect_instance> m_glyphs;
+			float m_width, m_height;
+			// Number of texts using the layout and the key it is stored under
+			size_t m_references;
+			layout_key const *m_key;
+		};
+
+		struct text_entry
+		{
+			layout *m_layout;
+			glyph_atlas::font_id m_font;
+			float m_size;
+			float m_x, m_y;
+			color m_fill;
+			GLuint m_z_index;
+			clip_rect m_clip;
+			::std::vector<rect_renderer::rect_id> m_rects;
+			bool m_visible;
+			bool m_used;
+		};
+
+		rect_renderer &m_rects;
+		glyph_atlas &m_atlas;
+
+		// Layouts are shared by all texts with the same string, font and size and are removed
+		// when the last of them is gone. Elements of an unordered_map never move, so pointers
+		// to them stay valid.
+		::std::unordered_map<layout_key, layout, layout_key_hash> m_layouts;
+		::std::vector<text_entry> m_texts;
+		::std::vector<text_id> m_free_ids;
+
+		layout& get_layout(char const *text, glyph_atlas::font_id font, float size);
+		void release_layout(layout &l);
+		void update_rects(text_entry &entry);
+	};
+
+} // namespace: graf
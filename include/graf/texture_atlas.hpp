@@ -0,0 +1,121 @@
+/**************************************************************************************************
+ * graf library                                                                                   *
+ * Copyright © 2012 David Kretzmer                                                                *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction,including without limitation the rights to use, copy, modify, merge, publish,      *
+ * distribute,sublicense, and/or sell copies of the Software, and to permit persons to whom the   *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#pragma once
+
+#include <graf/graf.hpp>
+#include <graf/opengl.hpp>
+#include <graf/shelf_packer.hpp>
+
+#include <vector>
+
+
+namespace graf
+{
+	//=============================================================================================
+	// Packs RGBA images into a single texture, so all images can be drawn without switching
+	// textures. Images only occupy space in the texture while they are used: if the texture is
+	// full, the shelf with the least recently used images is evicted and its images are uploaded
+	// again the next time they are used. New and evicted images are collected and uploaded once
+	// per frame through a streaming pixel buffer.
+	//=============================================================================================
+	class texture_atlas
+	{
+	public:
+		typedef uint image_id;
+
+		// The area of an image in the texture, in texels
+		struct region
+		{
+			GLushort position[2];
+			GLushort size[2];
+		};
+
+		// Constructor. Creates a texture of size x size texels.
+		texture_atlas(uint size = 2048);
+
+		// Destructor
+		~texture_atlas();
+
+		// Adds an image with 4 bytes per pixel (RGBA), row by row starting with the top row.
+		// The pixels are copied.
+		image_id add(uint width, uint height, GLubyte const *pixels);
+
+		// Removes an image
+		void remove(image_id id);
+
+		// Returns the region of the given image, making room for it if necessary. Every image
+		// that is displayed has to be used in every frame, otherwise it may be evicted. Throws an
+		// exception if there is no space left even after evicting all unused images.
+		region const& use(image_id id);
+
+		// Uploads all images that have been placed in the texture since the last call. Must be
+		// called before drawing.
+		void flush();
+
+		// Starts a new frame
+		void next_frame();
+
+		GLuint texture() const { return m_texture; }
+
+	private:
+		static uint const not_resident = static_cast<uint>(-1);
+
+		struct image
+		{
+			uint m_width, m_height;
+			::std::vector<GLubyte> m_pixels;
+			region m_region;
+			// The shelf the image is on, or not_resident
+			uint m_shelf;
+			bool m_used;
+			// Incremented when the slot is reused for another image
+			uint m_generation;
+		};
+
+		struct upload
+		{
+			image_id m_image;
+			uint m_generation;
+			size_t m_offset;
+		};
+
+		GLuint m_texture;
+		GLuint m_pixel_buffer;
+		uint m_size;
+		shelf_packer m_packer;
+
+		::std::vector<image> m_images;
+		::std::vector<image_id> m_free_ids;
+
+		// The frame in which each shelf was last used
+		::std::vector<uint> m_shelf_last_used;
+		uint m_frame;
+
+		// Images waiting to be uploaded and their pixels in one block
+		::std::vector<upload> m_uploads;
+		::std::vector<GLubyte> m_staging;
+
+		bool place(image &img);
+		bool evict();
+	};
+
+} // namespace: graf
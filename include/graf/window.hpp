@@ -26,6 +26,7 @@
 
 namespace graf
 {
+	struct screen_rect;
 	namespace internal { class window_impl; }
 
 	//=============================================================================================
@@ -47,14 +48,37 @@ namespace graf
 		// Returns false if the user has closed the window.
 		bool process_events();
 
+		// Like process_events(), but sleeps until at least one event has arrived. Use this
+		// instead of process_events() if there is nothing to render.
+		bool wait_events();
+
+		// Returns true if (parts of) the window have become visible since the last call, which
+		// means the window has to be redrawn.
+		bool exposed();
+
 		// Get screen dimension
 		uint screen_width();
 		uint screen_height();
 
+		// Returns the current size of the window, kept up to date by process_events(). When it
+		// changes, exposed() returns true.
+		uint width();
+		uint height();
+
 		// Swaps the backbuffer with the frontbuffer, so all your work becomes
 		// visible.
 		void swap_buffers();
 
+		// Makes the given regions of the backbuffer visible. Only these regions need to be
+		// up-to-date. Depending on the platform this may copy just these regions to the
+		// frontbuffer, or swap the whole buffers.
+		void swap_buffers(screen_rect const *regions, size_t num);
+
+		// Returns how many frames old the content of the backbuffer is, i.e. 1 if it contains
+		// the last frame, 2 if it contains the frame before the last one and so on. Returns 0 if
+		// the content is undefined and the whole frame has to be redrawn.
+		uint buffer_age();
+
 
 		internal::window_impl* platform_impl();
 
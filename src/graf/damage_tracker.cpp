@@ -0,0 +1,163 @@
+/**************************************************************************************************
+ * graf library                                                                                   *
+ * Copyright © 2012 David Kretzmer                                                                *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction,including without limitation the rights to use, copy, modify, merge, publish,      *
+ * distribute,sublicense, and/or sell copies of the Software, and to permit persons to whom the   *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include <graf/damage_tracker.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace graf
+{
+	namespace
+	{
+		bool overlap(screen_rect const &a, screen_rect const &b)
+		{
+			return a.x <= b.x + b.width && b.x <= a.x + a.width &&
+			       a.y <= b.y + b.height && b.y <= a.y + a.height;
+		}
+
+		screen_rect unite(screen_rect const &a, screen_rect const &b)
+		{
+			int left = ::std::min(a.x, b.x);
+			int top = ::std::min(a.y, b.y);
+			int right = ::std::max(a.x + a.width, b.x + b.width);
+			int bottom = ::std::max(a.y + a.height, b.y + b.height);
+
+			screen_rect result = {left, top, right - left, bottom - top};
+			return result;
+		}
+	}
+
+
+	//=============================================================================================
+	//
+	//=============================================================================================
+	damage_tracker::damage_tracker(uint width, uint height) :
+		m_width(width),
+		m_height(height),
+		m_num_frames(1)
+	{
+		add_all();
+	}
+
+
+	//=============================================================================================
+	// Adds a damaged area to the current frame. Areas that touch are merged.
+	//=============================================================================================
+	void damage_tracker::add(float x, float y, float width, float height)
+	{
+		int left = ::std::max(0, int(::std::floor(x)));
+		int top = ::std::max(0, int(::std::floor(y)));
+		int right = ::std::min(int(m_width), int(::std::ceil(x + width)));
+		int bottom = ::std::min(int(m_height), int(::std::ceil(y + height)));
+		if(left >= right || top >= bottom)
+			return;
+
+		screen_rect rect = {left, top, right - left, bottom - top};
+		merge(m_frames[0], rect);
+	}
+
+	void damage_tracker::add_all()
+	{
+		screen_rect all = {0, 0, int(m_width), int(m_height)};
+		m_frames[0].assign(1, all);
+	}
+
+	void damage_tracker::resize(uint width, uint height)
+	{
+		m_width = width;
+		m_height = height;
+		add_all();
+	}
+
+
+	//=============================================================================================
+	// Returns the areas that have to be redrawn
+	//=============================================================================================
+	::std::vector<screen_rect> const& damage_tracker::regions(uint buffer_age)
+	{
+		// If nothing has changed, what is visible is still up-to-date
+		if(empty())
+			m_regions.clear();
+		else if(buffer_age == 0 || buffer_age > m_num_frames)
+		{
+			screen_rect all = {0, 0, int(m_width), int(m_height)};
+			m_regions.assign(1, all);
+		}
+		else
+		{
+			m_regions = m_frames[0];
+			for(uint frame = 1; frame < buffer_age; ++frame)
+			{
+				for(auto const &rect: m_frames[frame])
+					merge(m_regions, rect);
+			}
+		}
+
+		return m_regions;
+	}
+
+
+	//=============================================================================================
+	// Finishes the current frame and starts a new one
+	//=============================================================================================
+	void damage_tracker::next_frame()
+	{
+		for(uint frame = max_age - 1; frame > 0; --frame)
+			m_frames[frame].swap(m_frames[frame - 1]);
+		m_frames[0].clear();
+
+		if(m_num_frames < max_age)
+			++m_num_frames;
+	}
+
+
+	//=============================================================================================
+	// Adds rect to rects, merging it with all rects it overlaps
+	//=============================================================================================
+	void damage_tracker::merge(::std::vector<screen_rect> &rects, screen_rect rect)
+	{
+		for(size_t i = 0; i < rects.size();)
+		{
+			if(overlap(rects[i], rect))
+			{
+				// The united rect may now overlap rects we have already checked
+				rect = unite(rects[i], rect);
+				rects[i] = rects.back();
+				rects.pop_back();
+				i = 0;
+			}
+			else
+				++i;
+		}
+
+		if(rects.size() < max_rects)
+			rects.push_back(rect);
+		else
+		{
+			for(auto const &other: rects)
+				rect = unite(rect, other);
+			rects.assign(1, rect);
+		}
+	}
+
+} // namespace: graf
@@ -0,0 +1,179 @@
+/**************************************************************************************************
+ * graf library                                                                                   *
+ * Copyright © 2012 David Kretzmer                                                                *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction,including without limitation the rights to use, copy, modify, merge, publish,      *
+ * distribute,sublicense, and/or sell copies of the Software, and to permit persons to whom the   *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include <graf/glyph_atlas.hpp>
+#include <graf/logger.hpp>
+
+#include <GL3/gl3w.h>
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace graf
+{
+	namespace
+	{
+		// Returns whether the given pixel belongs to the glyph
+		bool inside(glyph_bitmap const &bitmap, int x, int y)
+		{
+			return x >= 0 && y >= 0 && x < int(bitmap.width) && y < int(bitmap.height) &&
+			       bitmap.coverage[y * bitmap.width + x] >= 128;
+		}
+	}
+
+
+	//=============================================================================================
+	//
+	//=============================================================================================
+	glyph_atlas::glyph_atlas(uint size, uint base_size, uint spread) :
+		m_size(size),
+		m_base_size(base_size),
+		m_spread(spread),
+		m_packer(size, size)
+	{
+		glGenTextures(1, &m_texture);
+		glBindTexture(GL_TEXTURE_2D, m_texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, size, size, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+
+	glyph_atlas::~glyph_atlas()
+	{
+		glDeleteTextures(1, &m_texture);
+	}
+
+
+	//=============================================================================================
+	//
+	//=============================================================================================
+	glyph_atlas::font_id glyph_atlas::add_font(font *f)
+	{
+		m_fonts.push_back(f);
+		return m_fonts.size() - 1;
+	}
+
+	float glyph_atlas::line_height(font_id font, float pixel_size) const
+	{
+		assert(font < m_fonts.size());
+		return m_fonts[font]->line_height(m_base_size) * pixel_size / m_base_size;
+	}
+
+	float glyph_atlas::ascent(font_id font, float pixel_size) const
+	{
+		assert(font < m_fonts.size());
+		return m_fonts[font]->ascent(m_base_size) * pixel_size / m_base_size;
+	}
+
+
+	//=============================================================================================
+	// Returns the glyph of the given code point, adding it to the atlas if necessary
+	//=============================================================================================
+	glyph_atlas::glyph const& glyph_atlas::get(font_id font, uint code_point)
+	{
+		assert(font < m_fonts.size());
+
+		unsigned long long key = (static_cast<unsigned long long>(font) << 32) | code_point;
+		auto it = m_glyphs.find(key);
+		if(it != m_glyphs.end())
+			return it->second;
+
+		m_bitmap.coverage.clear();
+		m_fonts[font]->rasterize(code_point, m_base_size, m_bitmap);
+		assert(m_bitmap.coverage.size() == m_bitmap.width * m_bitmap.height);
+
+		glyph new_glyph;
+		new_glyph.left = float(m_bitmap.left) - m_spread;
+		new_glyph.top = float(m_bitmap.top) - m_spread;
+		new_glyph.advance = m_bitmap.advance;
+		new_glyph.texture_size[0] = GLushort(m_bitmap.width + 2 * m_spread);
+		new_glyph.texture_size[1] = GLushort(m_bitmap.height + 2 * m_spread);
+		new_glyph.texture_position[0] = new_glyph.texture_position[1] = 0;
+
+		// Glyphs without pixels (like spaces) don't need space in the texture
+		if(m_bitmap.width && m_bitmap.height)
+		{
+			// One texel of padding, so linear filtering doesn't pick up neighbouring glyphs
+			uint x, y, shelf;
+			if(!m_packer.allocate(new_glyph.texture_size[0] + 1, new_glyph.texture_size[1] + 1, &x, &y, &shelf))
+				throw light::runtime_error("Glyph atlas is full");
+			new_glyph.texture_position[0] = GLushort(x);
+			new_glyph.texture_position[1] = GLushort(y);
+
+			compute_distances();
+
+			glBindTexture(GL_TEXTURE_2D, m_texture);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, new_glyph.texture_position[0], new_glyph.texture_position[1],
+			                new_glyph.texture_size[0], new_glyph.texture_size[1],
+			                GL_RED, GL_UNSIGNED_BYTE, m_distances.data());
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		}
+
+		return m_glyphs.insert(::std::make_pair(key, new_glyph)).first->second;
+	}
+
+
+	//=============================================================================================
+	// Converts the coverage in m_bitmap to a signed distance field in m_distances. For every
+	// texel the closest texel on the other side of the outline within the spread is searched.
+	// This is brute force, but it only happens once per glyph.
+	//=============================================================================================
+	void glyph_atlas::compute_distances()
+	{
+		int const spread = m_spread;
+		int const width = m_bitmap.width, height = m_bitmap.height;
+		int const out_width = width + 2 * spread, out_height = height + 2 * spread;
+
+		m_distances.resize(out_width * out_height);
+		for(int y = 0; y < out_height; ++y)
+		{
+			for(int x = 0; x < out_width; ++x)
+			{
+				int const bx = x - spread, by = y - spread;
+				bool const is_inside = inside(m_bitmap, bx, by);
+
+				int min_sq_distance = (spread + 1) * (spread + 1);
+				for(int dy = -spread; dy <= spread; ++dy)
+				{
+					for(int dx = -spread; dx <= spread; ++dx)
+					{
+						int sq_distance = dx * dx + dy * dy;
+						if(sq_distance < min_sq_distance && inside(m_bitmap, bx + dx, by + dy) != is_inside)
+							min_sq_distance = sq_distance;
+					}
+				}
+
+				// The outline lies halfway between two texels
+				float distance = ::std::min(::std::sqrt(float(min_sq_distance)) - 0.5f, float(spread));
+				if(!is_inside)
+					distance = -distance;
+
+				float value = 0.5f + distance / (2.0f * spread);
+				m_distances[y * out_width + x] = GLubyte(::std::max(0.0f, ::std::min(1.0f, value)) * 255.0f + 0.5f);
+			}
+		}
+	}
+
+} // namespace: graf
@@ -63,7 +63,7 @@ namespace internal
 		XSync(m_window->display(), False);
 		check_for_errors();
 
-		glXMakeCurrent(m_window->display(), m_window->window(), m_context);
+		make_current();
 	}
 
 
@@ -77,6 +77,15 @@ namespace internal
 	}
 
 
+	//=============================================================================================
+	//
+	//=============================================================================================
+	void opengl_device_impl::make_current()
+	{
+		glXMakeCurrent(m_window->display(), m_window->window(), m_context);
+	}
+
+
 } // namespace: internal
 } // namespace: graf
 
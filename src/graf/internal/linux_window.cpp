@@ -24,6 +24,7 @@
 #ifdef LIGHT_PLATFORM_LINUX
 
 #include "graf/internal/linux_window.hpp"
+#include "graf/damage_tracker.hpp"
 #include "light/string/string.hpp"
 
 #include <X11/Xatom.h>
@@ -31,6 +32,12 @@
 #include <iostream>
 
 
+// GLX_EXT_buffer_age is younger than most glxext.h
+#ifndef GLX_BACK_BUFFER_AGE_EXT
+	#define GLX_BACK_BUFFER_AGE_EXT 0x20F4
+#endif
+
+
 namespace graf
 {
 namespace internal
@@ -123,6 +130,25 @@ namespace internal
 			// impressive (like choosing the *best* configuration...).
 			return configs.get()[0];
 		}
+
+
+		//=========================================================================================
+		// Returns whether the given GLX extension is supported
+		//=========================================================================================
+		bool has_glx_extension(::Display *display, int screen, char const *name)
+		{
+			char const *extensions = glXQueryExtensionsString(display, screen);
+			size_t const length = strlen(name);
+
+			// The extension names are separated by spaces
+			for(char const *pos = extensions; pos && (pos = strstr(pos, name)); pos += length)
+			{
+				if((pos == extensions || pos[-1] == ' ') && (pos[length] == ' ' || pos[length] == '\0'))
+					return true;
+			}
+
+			return false;
+		}
 	}
 
 
@@ -131,9 +157,19 @@ namespace internal
 	//=============================================================================================
 	window_impl::window_impl(utf8_unit const *_title, uint width, uint height, uint depth, uint stencil) :
 		m_screen(),
-		m_fb_config(get_best_fb_config(display(), screen(), depth, stencil))
-
+		m_exposed(true),
+		m_fb_config(get_best_fb_config(display(), screen(), depth, stencil)),
+		m_has_buffer_age(has_glx_extension(display(), screen(), "GLX_EXT_buffer_age")),
+		m_copy_sub_buffer(nullptr),
+		m_width(width),
+		m_height(height)
 	{
+		if(has_glx_extension(display(), screen(), "GLX_MESA_copy_sub_buffer"))
+		{
+			m_copy_sub_buffer = reinterpret_cast<glXCopySubBufferMESAProc>(
+				glXGetProcAddress(reinterpret_cast<GLubyte const*>("glXCopySubBufferMESA")));
+		}
+
 		xlib_ptr< ::XVisualInfo > visual(::glXGetVisualFromFBConfig(display(), m_fb_config));
 		if(!visual)
 			throw light::runtime_error("Cannot get visual info from config");
@@ -247,6 +283,25 @@ namespace internal
 					if(static_cast<Atom>(event.xclient.data.l[0]) == m_atom_delete_window)
 						return false;
 				break;
+
+				case Expose:
+					// Expose events come in groups, one for each rectangle that needs to be
+					// redrawn. Since we redraw the whole window anyway, we don't care about
+					// the rectangles.
+					m_exposed = true;
+				break;
+
+				case ConfigureNotify:
+					// Partial presents flip y with the window height, so it has to follow
+					// resizes. The contents of a resized window are undefined, so it is
+					// redrawn completely.
+					if(uint(event.xconfigure.width) != m_width || uint(event.xconfigure.height) != m_height)
+					{
+						m_width = event.xconfigure.width;
+						m_height = event.xconfigure.height;
+						m_exposed = true;
+					}
+				break;
 			}
 
 		} // loop: while
@@ -255,6 +310,31 @@ namespace internal
 	}
 
 
+	//=============================================================================================
+	// Like process_events(), but sleeps until at least one event has arrived
+	//=============================================================================================
+	bool window_impl::wait_events()
+	{
+		// XPeekEvent blocks until there is an event, but leaves it in the queue
+		XEvent event;
+		XPeekEvent(display(), &event);
+
+		return process_events();
+	}
+
+
+	//=============================================================================================
+	// Returns true if the window has received an Expose event since the last call
+	//=============================================================================================
+	bool window_impl::exposed()
+	{
+		bool result = m_exposed;
+		m_exposed = false;
+
+		return result;
+	}
+
+
 	//=============================================================================================
 	// Swaps the backbuffer with the frontbuffer so all your work becomes
 	// visible.
@@ -264,6 +344,47 @@ namespace internal
 		glXSwapBuffers(display(), m_window);
 	}
 
+
+	//=============================================================================================
+	// Makes the given regions of the backbuffer visible. If the driver tells us the age of the
+	// backbuffer, swapping is the fastest way since the caller has only redrawn the damaged
+	// regions anyway. Otherwise we copy the regions to the frontbuffer, which keeps the content
+	// of the backbuffer, so it is always one frame old.
+	//=============================================================================================
+	void window_impl::swap_buffers(screen_rect const *regions, size_t num)
+	{
+		if(m_has_buffer_age || !m_copy_sub_buffer)
+		{
+			swap_buffers();
+			return;
+		}
+
+		// GLX uses the bottom-left corner as origin
+		for(size_t i = 0; i < num; ++i)
+		{
+			int y = int(m_height) - regions[i].y - regions[i].height;
+			m_copy_sub_buffer(display(), m_window, regions[i].x, y, regions[i].width, regions[i].height);
+		}
+	}
+
+
+	//=============================================================================================
+	// Returns how many frames old the content of the backbuffer is, or 0 if it is undefined
+	//=============================================================================================
+	uint window_impl::buffer_age()
+	{
+		if(m_has_buffer_age)
+		{
+			unsigned int age = 0;
+			glXQueryDrawable(display(), m_window, GLX_BACK_BUFFER_AGE_EXT, &age);
+
+			return age;
+		}
+
+		// See swap_buffers()
+		return m_copy_sub_buffer ? 1 : 0;
+	}
+
 } // namespace: internal
 } // namespace: graf
 
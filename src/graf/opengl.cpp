@@ -31,6 +31,8 @@
 
 #include <GL3/gl3w.h>
 
+#include <algorithm>
+
 
 namespace graf
 {
@@ -48,6 +50,11 @@ namespace graf
 		glGetIntegerv(GL_MAJOR_VERSION, &major);
 		glGetIntegerv(GL_MINOR_VERSION, &minor);
 		GRAF_INFO_MSG("OpenGL {}.{} context created\n", major, minor);
+
+		int num_extensions = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+		for(int i = 0; i < num_extensions; ++i)
+			m_extensions.push_back(reinterpret_cast<char const*>(glGetStringi(GL_EXTENSIONS, i)));
 	}
 
 	opengl_device::~opengl_device()
@@ -55,6 +62,16 @@ namespace graf
 
 	}
 
+	bool opengl_device::has_extension(char const *name) const
+	{
+		return ::std::find(m_extensions.begin(), m_extensions.end(), name) != m_extensions.end();
+	}
+
+	void opengl_device::make_current()
+	{
+		m_impl->make_current();
+	}
+
 
 } // namespace: graf
 
@@ -0,0 +1,569 @@
+/**************************************************************************************************
+ * graf library                                                                                   *
+ * Copyright © 2012 David Kretzmer                                                                *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction,including without limitation the rights to use, copy, modify, merge, publish,      *
+ * distribute,sublicense, and/or sell copies of the Software, and to permit persons to whom the   *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include <graf/rect_renderer.hpp>
+
+#include <GL3/gl3w.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+
+namespace graf
+{
+	namespace
+	{
+		//=========================================================================================
+		// The quad is generated from gl_VertexID, so the only vertex data are the instances. Fill,
+		// outline and rounded corners are computed in the fragment shader from the signed
+		// distance to the rectangle, so every rectangle is a single quad.
+		//=========================================================================================
+		char const *vertex_source =
+			"#version 330 core\n"
+			"layout(location = 0) in vec4 in_rect;\n"
+			"layout(location = 1) in vec4 in_fill;\n"
+			"layout(location = 2) in vec4 in_outline;\n"
+			"layout(location = 3) in float in_outline_thickness;\n"
+			"layout(location = 4) in uint in_z_index;\n"
+			"layout(location = 5) in float in_corner_radius;\n"
+			"layout(location = 6) in vec4 in_texture;\n"
+			"layout(location = 7) in uint in_kind;\n"
+			"layout(location = 8) in vec4 in_clip;\n"
+			"uniform vec2 u_viewport;\n"
+			"uniform float u_depth_scale;\n"
+			"out vec2 v_local;\n"
+			"flat out vec2 v_size;\n"
+			"flat out vec4 v_fill;\n"
+			"flat out vec4 v_outline;\n"
+			"flat out float v_outline_thickness;\n"
+			"flat out float v_corner_radius;\n"
+			"flat out vec4 v_texture;\n"
+			"flat out uint v_kind;\n"
+			"void main()\n"
+			"{\n"
+			"	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);\n"
+			"	v_local = corner * (in_rect.zw + 2.0 * in_outline_thickness) - in_outline_thickness;\n"
+			// Clipping moves the corners of the quad instead of discarding fragments, so
+			// clipped parts are never rasterized and early depth testing keeps working
+			"	if(in_clip.z > 0.0 || in_clip.w > 0.0)\n"
+			"		v_local = clamp(in_rect.xy + v_local, in_clip.xy, in_clip.xy + in_clip.zw) - in_rect.xy;\n"
+			"	v_size = in_rect.zw;\n"
+			"	v_fill = in_fill;\n"
+			"	v_outline = in_outline;\n"
+			"	v_outline_thickness = in_outline_thickness;\n"
+			"	v_corner_radius = min(in_corner_radius, 0.5 * min(in_rect.z, in_rect.w));\n"
+			"	v_texture = in_texture;\n"
+			"	v_kind = in_kind;\n"
+			"	vec2 pos = (in_rect.xy + v_local) / u_viewport;\n"
+			"	float depth = 1.0 - float(in_z_index + 1u) * u_depth_scale;\n"
+			"	gl_Position = vec4(pos.x * 2.0 - 1.0, 1.0 - pos.y * 2.0, depth * 2.0 - 1.0, 1.0);\n"
+			"}\n";
+
+		char const *fragment_source =
+			"#version 330 core\n"
+			"in vec2 v_local;\n"
+			"flat in vec2 v_size;\n"
+			"flat in vec4 v_fill;\n"
+			"flat in vec4 v_outline;\n"
+			"flat in float v_outline_thickness;\n"
+			"flat in float v_corner_radius;\n"
+			"flat in vec4 v_texture;\n"
+			"flat in uint v_kind;\n"
+			"uniform sampler2D u_glyphs;\n"
+			"uniform float u_glyph_spread;\n"
+			"uniform sampler2D u_images;\n"
+			"out vec4 out_color;\n"
+			// Signed distance to a rounded rectangle at the origin, negative inside
+			"float rounded_rect(vec2 p, vec2 size, float radius)\n"
+			"{\n"
+			"	vec2 q = abs(p - 0.5 * size) - 0.5 * size + radius;\n"
+			"	return length(max(q, 0.0)) + min(max(q.x, q.y), 0.0) - radius;\n"
+			"}\n"
+			// The glyph texture stores the distance to the glyph's outline, mapped from
+			// [-spread, spread] texels to [0, 1]. Scaling it to screen pixels gives exact
+			// anti-aliasing at every size.
+			"vec2 texture_coords(sampler2D tex)\n"
+			"{\n"
+			"	return (v_texture.xy + v_local / v_size * v_texture.zw) / vec2(textureSize(tex, 0));\n"
+			"}\n"
+			"float glyph_coverage()\n"
+			"{\n"
+			"	vec2 uv = texture_coords(u_glyphs);\n"
+			"	float distance = (texture(u_glyphs, uv).r - 0.5) * 2.0 * u_glyph_spread;\n"
+			"	return clamp(distance * v_size.x / v_texture.z + 0.5, 0.0, 1.0);\n"
+			"}\n"
+			"void main()\n"
+			"{\n"
+			"	if(v_kind == 1u)\n"
+			"	{\n"
+			"		out_color = vec4(v_fill.rgb, v_fill.a * glyph_coverage());\n"
+			"		return;\n"
+			"	}\n"
+			// Images are clipped to the rounded rectangle and get an outline just like a fill
+			"	vec4 fill = v_fill;\n"
+			"	if(v_kind == 2u)\n"
+			"		fill *= texture(u_images, texture_coords(u_images));\n"
+			"	float inner = rounded_rect(v_local, v_size, v_corner_radius);\n"
+			"	float outer = inner - v_outline_thickness;\n"
+			// Distances are in pixels, so this gives one pixel of anti-aliasing
+			"	float fill_coverage = clamp(0.5 - inner, 0.0, 1.0);\n"
+			"	float coverage = clamp(0.5 - outer, 0.0, 1.0);\n"
+			"	vec4 color = v_outline_thickness > 0.0 ? mix(v_outline, fill, fill_coverage) : fill;\n"
+			"	out_color = vec4(color.rgb, color.a * coverage);\n"
+			"}\n";
+
+		// Opaque rectangles are drawn front-to-back with depth writes, everything else
+		// back-to-front with blending. Rounded corners and glyphs are anti-aliased, so they need
+		// blending, and images may contain transparent pixels.
+		bool is_opaque(rect_instance const &rect)
+		{
+			return rect.kind == rect_solid && rect.fill.a == 255 &&
+			       (rect.outline_thickness <= 0 || rect.outline.a == 255) && rect.corner_radius <= 0;
+		}
+
+		// Dirty ranges that are at most this many instances apart are uploaded together, since
+		// uploading a few unchanged instances is cheaper than another call into the driver
+		size_t const merge_distance = 16;
+
+		//=========================================================================================
+		// Sorts the keys by z-index with an LSD radix sort, one byte per pass. The sort is
+		// stable, so keys with the same z-index keep their order. Passes in which all keys have
+		// the same byte are skipped, which in practice removes most of them since z-indices
+		// rarely use all 32 bits.
+		//=========================================================================================
+		template<typename Key>
+		void radix_sort(::std::vector<Key> &keys, ::std::vector<Key> &buffer)
+		{
+			size_t const num = keys.size();
+			buffer.resize(num);
+
+			for(uint shift = 0; shift < 32; shift += 8)
+			{
+				size_t offsets[256] = {};
+				for(size_t i = 0; i < num; ++i)
+					++offsets[(keys[i].z_index >> shift) & 0xFF];
+
+				if(offsets[(keys[0].z_index >> shift) & 0xFF] == num)
+					continue;
+
+				size_t sum = 0;
+				for(size_t digit = 0; digit < 256; ++digit)
+				{
+					size_t count = offsets[digit];
+					offsets[digit] = sum;
+					sum += count;
+				}
+
+				for(size_t i = 0; i < num; ++i)
+					buffer[offsets[(keys[i].z_index >> shift) & 0xFF]++] = keys[i];
+
+				keys.swap(buffer);
+			}
+		}
+	}
+
+
+	//=============================================================================================
+	//
+	//=============================================================================================
+	rect_renderer::rect_renderer(shader_manager &shaders) :
+		m_shaders(shaders),
+		m_damage(nullptr),
+		m_program(shaders.add(vertex_source, fragment_source)),
+		m_viewport_location(-1),
+		m_depth_scale_location(-1),
+		m_glyph_spread_location(-1),
+		m_images_location(-1),
+		m_glyph_texture(0),
+		m_glyph_spread(0),
+		m_image_texture(0),
+		m_buffer_capacity(0),
+		m_opaque_count(0),
+		m_ids_changed(false),
+		m_order_changed(false)
+	{
+		glGenVertexArrays(1, &m_vertex_array);
+		glGenBuffers(1, &m_instance_buffer);
+
+		glBindVertexArray(m_vertex_array);
+		glBindBuffer(GL_ARRAY_BUFFER, m_instance_buffer);
+
+		bind_instances(0);
+		for(GLuint attrib = 0; attrib < 9; ++attrib)
+		{
+			glEnableVertexAttribArray(attrib);
+			glVertexAttribDivisor(attrib, 1);
+		}
+
+		glBindVertexArray(0);
+	}
+
+	rect_renderer::~rect_renderer()
+	{
+		glDeleteBuffers(1, &m_instance_buffer);
+		glDeleteVertexArrays(1, &m_vertex_array);
+	}
+
+
+	//=============================================================================================
+	//
+	//=============================================================================================
+	rect_renderer::rect_id rect_renderer::add(rect_instance const &rect)
+	{
+		rect_id id;
+		if(m_free_ids.empty())
+		{
+			id = m_rects.size();
+			m_rects.push_back(rect);
+			m_used.push_back(true);
+			m_positions.push_back(0);
+			m_is_dirty.push_back(false);
+		}
+		else
+		{
+			id = m_free_ids.back();
+			m_free_ids.pop_back();
+			m_rects[id] = rect;
+			m_used[id] = true;
+
+			// If the order stays the same, sort() keeps the old buffer, which still contains
+			// the removed rect in this slot
+			if(!m_is_dirty[id])
+			{
+				m_is_dirty[id] = true;
+				m_dirty.push_back(id);
+			}
+		}
+
+		m_ids_changed = true;
+		add_damage(rect);
+
+		return id;
+	}
+
+	void rect_renderer::change(rect_id id, rect_instance const &rect)
+	{
+		assert(id < m_rects.size() && m_used[id]);
+
+		// rect_instance has no padding, so comparing the bytes is fine
+		if(::std::memcmp(&m_rects[id], &rect, sizeof(rect_instance)) == 0)
+			return;
+
+		if(m_rects[id].z_index != rect.z_index || is_opaque(m_rects[id]) != is_opaque(rect))
+			m_order_changed = true;
+
+		add_damage(m_rects[id]);
+		add_damage(rect);
+
+		m_rects[id] = rect;
+		if(!m_is_dirty[id])
+		{
+			m_is_dirty[id] = true;
+			m_dirty.push_back(id);
+		}
+	}
+
+	rect_instance const& rect_renderer::get(rect_id id) const
+	{
+		assert(id < m_rects.size() && m_used[id]);
+		return m_rects[id];
+	}
+
+	void rect_renderer::remove(rect_id id)
+	{
+		assert(id < m_rects.size() && m_used[id]);
+
+		m_used[id] = false;
+		m_free_ids.push_back(id);
+		m_ids_changed = true;
+		add_damage(m_rects[id]);
+	}
+
+
+	//=============================================================================================
+	// Reports the area covered by the given rectangle, including its outline and excluding
+	// everything outside of its clip rect
+	//=============================================================================================
+	void rect_renderer::add_damage(rect_instance const &rect)
+	{
+		if(m_damage)
+		{
+			GLfloat outline = ::std::max(rect.outline_thickness, 0.0f);
+			GLfloat left = rect.position[0] - outline;
+			GLfloat top = rect.position[1] - outline;
+			GLfloat right = rect.position[0] + rect.size[0] + outline;
+			GLfloat bottom = rect.position[1] + rect.size[1] + outline;
+
+			if(rect.clip.size[0] || rect.clip.size[1])
+			{
+				left = ::std::max(left, GLfloat(rect.clip.position[0]));
+				top = ::std::max(top, GLfloat(rect.clip.position[1]));
+				right = ::std::min(right, GLfloat(rect.clip.position[0] + rect.clip.size[0]));
+				bottom = ::std::min(bottom, GLfloat(rect.clip.position[1] + rect.clip.size[1]));
+				if(right <= left || bottom <= top)
+					return;
+			}
+
+			m_damage->add(left, top, right - left, bottom - top);
+		}
+	}
+
+
+	//=============================================================================================
+	// Draws the opaque rectangles front-to-back, so the depth test rejects the hidden parts of
+	// rectangles behind them before they are shaded, and then all other rectangles back-to-front
+	// with blending. The z-index is used as depth.
+	//=============================================================================================
+	void rect_renderer::display(uint viewport_width, uint viewport_height)
+	{
+		GLuint program = m_shaders.program(m_program);
+		if(!program)
+			return;
+
+		if(m_viewport_location == -1)
+		{
+			m_viewport_location = glGetUniformLocation(program, "u_viewport");
+			m_depth_scale_location = glGetUniformLocation(program, "u_depth_scale");
+			m_glyph_spread_location = glGetUniformLocation(program, "u_glyph_spread");
+			m_images_location = glGetUniformLocation(program, "u_images");
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, m_instance_buffer);
+		if(m_ids_changed || m_order_changed)
+			sort();
+		upload();
+
+		if(m_order.empty())
+			return;
+
+		// Maps the z-indices to the depth range (0, 1], the highest z-index being the closest
+		GLuint max_z = 0;
+		if(m_opaque_count)
+			max_z = m_sorted.front().z_index;
+		if(m_opaque_count < m_sorted.size())
+			max_z = ::std::max(max_z, m_sorted.back().z_index);
+
+		glUseProgram(program);
+		glUniform2f(m_viewport_location, GLfloat(viewport_width), GLfloat(viewport_height));
+		glUniform1f(m_depth_scale_location, 1.0f / (GLfloat(max_z) + 2.0f));
+		glUniform1f(m_glyph_spread_location, GLfloat(m_glyph_spread));
+		glUniform1i(m_images_location, 1);
+
+		if(m_glyph_texture)
+		{
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, m_glyph_texture);
+		}
+		if(m_image_texture)
+		{
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_2D, m_image_texture);
+			glActiveTexture(GL_TEXTURE0);
+		}
+
+		glBindVertexArray(m_vertex_array);
+		glEnable(GL_DEPTH_TEST);
+
+		if(m_opaque_count)
+		{
+			glDisable(GL_BLEND);
+			glDepthMask(GL_TRUE);
+			glDepthFunc(GL_LESS);
+
+			bind_instances(0);
+			glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, m_opaque_count);
+		}
+
+		if(m_opaque_count < m_order.size())
+		{
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			glDepthMask(GL_FALSE);
+			glDepthFunc(GL_LEQUAL);
+
+			bind_instances(m_opaque_count);
+			glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, m_order.size() - m_opaque_count);
+		}
+
+		// glClear() only clears the depth buffer if depth writes are enabled
+		glDepthMask(GL_TRUE);
+		glDisable(GL_DEPTH_TEST);
+		glBindVertexArray(0);
+	}
+
+
+	//=============================================================================================
+	// Points the instance attributes of the currently bound vertex array to the given instance
+	//=============================================================================================
+	void rect_renderer::bind_instances(size_t first)
+	{
+		GLsizei const stride = sizeof(rect_instance);
+		char const *base = reinterpret_cast<char const*>(first * sizeof(rect_instance));
+
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride, base + offsetof(rect_instance, position));
+		glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, base + offsetof(rect_instance, fill));
+		glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, base + offsetof(rect_instance, outline));
+		glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, stride, base + offsetof(rect_instance, outline_thickness));
+		glVertexAttribIPointer(4, 1, GL_UNSIGNED_INT, stride, base + offsetof(rect_instance, z_index));
+		glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, stride, base + offsetof(rect_instance, corner_radius));
+		glVertexAttribPointer(6, 4, GL_UNSIGNED_SHORT, GL_FALSE, stride, base + offsetof(rect_instance, texture_position));
+		glVertexAttribIPointer(7, 1, GL_UNSIGNED_INT, stride, base + offsetof(rect_instance, kind));
+		glVertexAttribPointer(8, 4, GL_UNSIGNED_SHORT, GL_FALSE, stride, base + offsetof(rect_instance, clip));
+	}
+
+
+	//=============================================================================================
+	// Brings all rectangles into drawing order and uploads the whole instance buffer if the
+	// order has changed
+	//=============================================================================================
+	void rect_renderer::sort()
+	{
+		// A changed z-index often doesn't change the order (e.g. if a whole subtree has been
+		// moved to the front), in which case only the changed rectangles need to be uploaded
+		if(!m_ids_changed && in_z_order())
+		{
+			m_order_changed = false;
+			return;
+		}
+
+		m_keys.clear();
+		for(rect_id id = 0; id < m_rects.size(); ++id)
+		{
+			if(m_used[id])
+			{
+				sort_key key = {m_rects[id].z_index, id};
+				m_keys.push_back(key);
+			}
+		}
+
+		// Rects with the same z-index keep the order of their IDs
+		if(!m_keys.empty())
+			radix_sort(m_keys, m_key_buffer);
+
+		m_ids_changed = false;
+		m_order_changed = false;
+
+		// Opaque rects go first in reverse order (front-to-back), then the translucent ones
+		m_key_buffer.clear();
+		for(size_t i = m_keys.size(); i-- > 0;)
+		{
+			if(is_opaque(m_rects[m_keys[i].id]))
+				m_key_buffer.push_back(m_keys[i]);
+		}
+		size_t const opaque_count = m_key_buffer.size();
+		for(size_t i = 0; i < m_keys.size(); ++i)
+		{
+			if(!is_opaque(m_rects[m_keys[i].id]))
+				m_key_buffer.push_back(m_keys[i]);
+		}
+
+		bool same_order = m_key_buffer.size() == m_order.size() && opaque_count == m_opaque_count;
+		for(size_t pos = 0; same_order && pos < m_key_buffer.size(); ++pos)
+			same_order = m_key_buffer[pos].id == m_order[pos];
+		if(same_order)
+			return;
+
+		m_opaque_count = opaque_count;
+		m_order.resize(m_key_buffer.size());
+		m_sorted.resize(m_key_buffer.size());
+		for(uint pos = 0; pos < m_key_buffer.size(); ++pos)
+		{
+			rect_id id = m_key_buffer[pos].id;
+			m_order[pos] = id;
+			m_sorted[pos] = m_rects[id];
+			m_positions[id] = pos;
+		}
+
+		for(auto id: m_dirty)
+			m_is_dirty[id] = false;
+		m_dirty.clear();
+
+		// Orphan the old buffer so we don't have to wait until the GPU is done with it
+		size_t const size = m_sorted.size() * sizeof(rect_instance);
+		if(size > m_buffer_capacity)
+			m_buffer_capacity = ::std::max(size, 2 * m_buffer_capacity);
+		glBufferData(GL_ARRAY_BUFFER, m_buffer_capacity, nullptr, GL_DYNAMIC_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, size, m_sorted.data());
+	}
+
+	// Returns whether the current drawing order is still valid, i.e. the opaque rectangles are
+	// sorted front-to-back and the others back-to-front
+	bool rect_renderer::in_z_order() const
+	{
+		for(size_t pos = 0; pos < m_order.size(); ++pos)
+		{
+			rect_instance const &rect = m_rects[m_order[pos]];
+			if(is_opaque(rect) != (pos < m_opaque_count))
+				return false;
+
+			if(pos == 0 || pos == m_opaque_count)
+				continue;
+
+			GLuint prev_z = m_rects[m_order[pos - 1]].z_index;
+			if(pos < m_opaque_count ? prev_z < rect.z_index : prev_z > rect.z_index)
+				return false;
+		}
+
+		return true;
+	}
+
+
+	//=============================================================================================
+	// Uploads the rectangles that have changed since the last frame
+	//=============================================================================================
+	void rect_renderer::upload()
+	{
+		if(m_dirty.empty())
+			return;
+
+		// Collect the changed positions in ascending order so neighbouring changes can be
+		// uploaded together
+		::std::vector<uint> positions;
+		positions.reserve(m_dirty.size());
+		for(auto id: m_dirty)
+		{
+			uint pos = m_positions[id];
+			m_sorted[pos] = m_rects[id];
+			positions.push_back(pos);
+			m_is_dirty[id] = false;
+		}
+		m_dirty.clear();
+		::std::sort(positions.begin(), positions.end());
+
+		size_t first = positions[0], last = positions[0];
+		for(size_t i = 1; i <= positions.size(); ++i)
+		{
+			if(i < positions.size() && positions[i] - last <= merge_distance)
+			{
+				last = positions[i];
+				continue;
+			}
+
+			glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(rect_instance),
+			                (last - first + 1) * sizeof(rect_instance), &m_sorted[first]);
+
+			if(i < positions.size())
+				first = last = positions[i];
+		}
+	}
+
+} // namespace: graf
@@ -0,0 +1,247 @@
+/**************************************************************************************************
+ * graf library                                                                                   *
+ * Copyright © 2012 David Kretzmer                                                                *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction,including without limitation the rights to use, copy, modify, merge, publish,      *
+ * distribute,sublicense, and/or sell copies of the Software, and to permit persons to whom the   *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include <graf/shader.hpp>
+#include <graf/logger.hpp>
+#include <light/string/string.hpp>
+
+#include <GL3/gl3w.h>
+
+#include <cassert>
+
+
+// KHR_parallel_shader_compile is younger than our gl3.h
+#ifndef GL_KHR_parallel_shader_compile
+	#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+	#define GL_COMPLETION_STATUS_KHR 0x91B1
+
+	typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC) (GLuint count);
+#endif
+
+
+namespace graf
+{
+	namespace
+	{
+		//=========================================================================================
+		// Returns the info log of the given shader or program
+		//=========================================================================================
+		::std::string shader_log(GLuint shader)
+		{
+			GLint length = 0;
+			glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+
+			::std::string log(length > 0 ? length : 1, '\0');
+			glGetShaderInfoLog(shader, log.size(), nullptr, &log[0]);
+
+			return log;
+		}
+
+		::std::string program_log(GLuint program)
+		{
+			GLint length = 0;
+			glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+
+			::std::string log(length > 0 ? length : 1, '\0');
+			glGetProgramInfoLog(program, log.size(), nullptr, &log[0]);
+
+			return log;
+		}
+
+		GLuint create_shader(GLenum type, ::std::string const &source)
+		{
+			GLuint shader = glCreateShader(type);
+			char const *source_ptr = source.c_str();
+			glShaderSource(shader, 1, &source_ptr, nullptr);
+			glCompileShader(shader);
+
+			return shader;
+		}
+	}
+
+
+	//=============================================================================================
+	//
+	//=============================================================================================
+	shader_manager::shader_manager(opengl_device &device) :
+		m_pending(0),
+		m_parallel(device.has_extension("GL_KHR_parallel_shader_compile") ||
+		           device.has_extension("GL_ARB_parallel_shader_compile"))
+	{
+		if(m_parallel)
+		{
+			// Both extensions define the same entry point, only with different suffixes
+			PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glMaxShaderCompilerThreadsKHR =
+				reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(gl3wGetProcAddress("glMaxShaderCompilerThreadsKHR"));
+			if(!glMaxShaderCompilerThreadsKHR)
+				glMaxShaderCompilerThreadsKHR = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(gl3wGetProcAddress("glMaxShaderCompilerThreadsARB"));
+
+			// 0xFFFFFFFF lets the driver choose the number of threads
+			if(glMaxShaderCompilerThreadsKHR)
+				glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+			else
+				m_parallel = false;
+		}
+
+		GRAF_INFO_MSG("Parallel shader compilation {}\n", m_parallel ? "enabled" : "not available");
+	}
+
+	shader_manager::~shader_manager()
+	{
+		// Entries that are still linking or failed to link own their shaders as well. Unused
+		// names are 0, which OpenGL silently ignores.
+		for(auto &entry: m_programs)
+		{
+			glDeleteShader(entry.m_vertex_shader);
+			glDeleteShader(entry.m_fragment_shader);
+			glDeleteProgram(entry.m_program);
+		}
+	}
+
+
+	//=============================================================================================
+	// Queues a program consisting of the given vertex and fragment shader
+	//=============================================================================================
+	shader_manager::program_id shader_manager::add(char const *vertex_source, char const *fragment_source)
+	{
+		program_entry entry = {vertex_source, fragment_source, 0, 0, 0, queued};
+		m_programs.push_back(entry);
+
+		return m_programs.size() - 1;
+	}
+
+
+	//=============================================================================================
+	// Starts compiling and linking all queued programs. All compile requests are issued before
+	// the first link request so the driver can work on as many shaders at once as possible.
+	//=============================================================================================
+	void shader_manager::submit()
+	{
+		for(auto &entry: m_programs)
+		{
+			if(entry.m_state == queued)
+			{
+				entry.m_vertex_shader = create_shader(GL_VERTEX_SHADER, entry.m_vertex_source);
+				entry.m_fragment_shader = create_shader(GL_FRAGMENT_SHADER, entry.m_fragment_source);
+			}
+		}
+
+		for(auto &entry: m_programs)
+		{
+			if(entry.m_state == queued)
+			{
+				entry.m_program = glCreateProgram();
+				glAttachShader(entry.m_program, entry.m_vertex_shader);
+				glAttachShader(entry.m_program, entry.m_fragment_shader);
+				glLinkProgram(entry.m_program);
+
+				entry.m_state = linking;
+				++m_pending;
+			}
+		}
+	}
+
+
+	//=============================================================================================
+	// Returns true if all submitted programs have been linked
+	//=============================================================================================
+	bool shader_manager::poll()
+	{
+		for(size_t i = 0; i < m_programs.size() && m_pending; ++i)
+		{
+			program_entry &entry = m_programs[i];
+			if(entry.m_state != linking)
+				continue;
+
+			// Without the extension, querying GL_LINK_STATUS in complete() simply blocks
+			if(m_parallel)
+			{
+				GLint done = GL_FALSE;
+				glGetProgramiv(entry.m_program, GL_COMPLETION_STATUS_KHR, &done);
+				if(!done)
+					continue;
+			}
+
+			complete(entry);
+		}
+
+		return m_pending == 0;
+	}
+
+	void shader_manager::finish()
+	{
+		for(auto &entry: m_programs)
+		{
+			if(entry.m_state == linking)
+				complete(entry);
+		}
+	}
+
+
+	//=============================================================================================
+	//
+	//=============================================================================================
+	bool shader_manager::ready(program_id id) const
+	{
+		assert(id < m_programs.size());
+		return m_programs[id].m_state == linked;
+	}
+
+	GLuint shader_manager::program(program_id id) const
+	{
+		return ready(id) ? m_programs[id].m_program : 0;
+	}
+
+
+	//=============================================================================================
+	// Checks the result of a program whose compilation has finished
+	//=============================================================================================
+	void shader_manager::complete(program_entry &entry)
+	{
+		GLint status = GL_FALSE;
+		glGetProgramiv(entry.m_program, GL_LINK_STATUS, &status);
+
+		if(status != GL_TRUE)
+		{
+			// Compile errors show up as link errors, but the useful message is in the shader log
+			light::utf8_string error("Linking shader program failed: ");
+			error += program_log(entry.m_program);
+			error += "\nVertex shader: " + shader_log(entry.m_vertex_shader);
+			error += "\nFragment shader: " + shader_log(entry.m_fragment_shader);
+
+			throw light::runtime_error(error);
+		}
+
+		// The shader objects are not needed anymore once the program is linked
+		glDetachShader(entry.m_program, entry.m_vertex_shader);
+		glDetachShader(entry.m_program, entry.m_fragment_shader);
+		glDeleteShader(entry.m_vertex_shader);
+		glDeleteShader(entry.m_fragment_shader);
+		entry.m_vertex_shader = 0;
+		entry.m_fragment_shader = 0;
+
+		entry.m_vertex_source.clear();
+		entry.m_fragment_source.clear();
+		entry.m_state = linked;
+		--m_pending;
+	}
+
+} // namespace: graf
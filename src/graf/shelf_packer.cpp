@@ -0,0 +1,139 @@
+/**************************************************************************************************
+ * graf library                                                                                   *
+ * Copyright © 2012 David Kretzmer                                                                *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction,including without limitation the rights to use, copy, modify, merge, publish,      *
+ * distribute,sublicense, and/or sell copies of the Software, and to permit persons to whom the   *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include <graf/shelf_packer.hpp>
+
+
+namespace graf
+{
+	//=============================================================================================
+	//
+	//=============================================================================================
+	shelf_packer::shelf_packer(uint width, uint height) :
+		m_width(width),
+		m_height(height)
+	{
+
+	}
+
+
+	//=============================================================================================
+	// Finds a free area of the given size
+	//=============================================================================================
+	bool shelf_packer::allocate(uint width, uint height, uint *x, uint *y, uint *shelf)
+	{
+		if(width > m_width)
+			return false;
+
+		// Shelves that are up to 25% higher than the rectangle are fine
+		shelf_data *best = nullptr;
+		for(auto &s: m_shelves)
+		{
+			if(s.height >= height && s.height <= height + height / 4 && s.used_width + width <= m_width)
+			{
+				if(!best || s.height < best->height)
+					best = &s;
+			}
+		}
+
+		if(!best)
+		{
+			uint top = m_shelves.empty() ? 0 : m_shelves.back().y + m_shelves.back().height;
+			if(top + height > m_height)
+			{
+				// As a last resort take any shelf that is high enough, wasting some height
+				for(auto &s: m_shelves)
+				{
+					if(s.height >= height && s.used_width + width <= m_width && (!best || s.height < best->height))
+						best = &s;
+				}
+
+				if(!best)
+					return false;
+			}
+			else
+			{
+				shelf_data new_shelf = {top, height, 0};
+				m_shelves.push_back(new_shelf);
+				best = &m_shelves.back();
+			}
+		}
+
+		*x = best->used_width;
+		*y = best->y;
+		*shelf = best - m_shelves.data();
+		best->used_width += width;
+
+		return true;
+	}
+
+
+	//=============================================================================================
+	// Shelves that would be empty after clearing are free at the top of the stack, or can take
+	// any rectangle that isn't higher than they are
+	//=============================================================================================
+	bool shelf_packer::could_allocate(uint width, uint height, ::std::vector<bool> const &reclaimable) const
+	{
+		if(width > m_width)
+			return false;
+
+		uint top = m_shelves.size();
+		while(top > 0 && would_be_empty(top - 1, reclaimable))
+			--top;
+
+		uint free_y = top ? m_shelves[top - 1].y + m_shelves[top - 1].height : 0;
+		if(free_y + height <= m_height)
+			return true;
+
+		for(uint i = 0; i < top; ++i)
+		{
+			shelf_data const &s = m_shelves[i];
+			if(s.height >= height && (would_be_empty(i, reclaimable) || s.used_width + width <= m_width))
+				return true;
+		}
+
+		return false;
+	}
+
+
+	//=============================================================================================
+	// Empty shelves at the top give their height back to the free area
+	//=============================================================================================
+	void shelf_packer::clear_shelf(uint shelf)
+	{
+		assert(shelf < m_shelves.size());
+		m_shelves[shelf].used_width = 0;
+
+		while(!m_shelves.empty() && m_shelves.back().used_width == 0)
+			m_shelves.pop_back();
+	}
+
+	bool shelf_packer::would_be_empty(uint shelf, ::std::vector<bool> const &reclaimable) const
+	{
+		return m_shelves[shelf].used_width == 0 || (shelf < reclaimable.size() && reclaimable[shelf]);
+	}
+
+	void shelf_packer::clear()
+	{
+		m_shelves.clear();
+	}
+
+} // namespace: graf
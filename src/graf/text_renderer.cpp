@@ -0,0 +1,310 @@
+/**************************************************************************************************
+ * graf library                                                                                   *
+ * Copyright © 2012 David Kretzmer                                                                *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction,including without limitation the rights to use, copy, modify, merge, publish,      *
+ * distribute,sublicense, and/or sell copies of the Software, and to permit persons to whom the   *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include <graf/text_renderer.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+
+namespace graf
+{
+	namespace
+	{
+		//=========================================================================================
+		// Decodes the next code point of a UTF-8 string and advances the pointer. Invalid
+		// sequences are returned byte by byte.
+		//=========================================================================================
+		uint next_code_point(char const *&text)
+		{
+			unsigned char const first = *text++;
+			uint num_following;
+			uint code_point;
+
+			if(first < 0x80)
+				return first;
+			else if((first & 0xE0) == 0xC0)
+			{
+				num_following = 1;
+				code_point = first & 0x1F;
+			}
+			else if((first & 0xF0) == 0xE0)
+			{
+				num_following = 2;
+				code_point = first & 0x0F;
+			}
+			else if((first & 0xF8) == 0xF0)
+			{
+				num_following = 3;
+				code_point = first & 0x07;
+			}
+			else
+				return first;
+
+			for(uint i = 0; i < num_following; ++i)
+			{
+				unsigned char const next = *text;
+				if((next & 0xC0) != 0x80)
+					return first;
+
+				code_point = (code_point << 6) | (next & 0x3F);
+				++text;
+			}
+
+			return code_point;
+		}
+	}
+
+
+	//=============================================================================================
+	//
+	//=============================================================================================
+	size_t text_renderer::layout_key_hash::operator () (layout_key const &key) const
+	{
+		size_t hash = ::std::hash< ::std::string >()(key.m_text);
+		hash ^= ::std::hash<float>()(key.m_size) + 0x9E3779B9 + (hash << 6) + (hash >> 2);
+		hash ^= ::std::hash<uint>()(key.m_font) + 0x9E3779B9 + (hash << 6) + (hash >> 2);
+
+		return hash;
+	}
+
+
+	//=============================================================================================
+	//
+	//=============================================================================================
+	text_renderer::text_renderer(rect_renderer &rects, glyph_atlas &atlas) :
+		m_rects(rects),
+		m_atlas(atlas)
+	{
+		m_rects.glyph_texture(atlas.texture(), atlas.spread());
+	}
+
+
+	//=============================================================================================
+	//
+	//=============================================================================================
+	text_renderer::text_id text_renderer::add(char const *text, glyph_atlas::font_id font, float size,
+	                                          float x, float y, color fill, GLuint z_index)
+	{
+		text_id id;
+		if(m_free_ids.empty())
+		{
+			id = m_texts.size();
+			m_texts.push_back(text_entry());
+		}
+		else
+		{
+			id = m_free_ids.back();
+			m_free_ids.pop_back();
+		}
+
+		text_entry &entry = m_texts[id];
+		entry.m_layout = &get_layout(text, font, size);
+		entry.m_font = font;
+		entry.m_size = size;
+		entry.m_x = x;
+		entry.m_y = y;
+		entry.m_fill = fill;
+		entry.m_z_index = z_index;
+		entry.m_clip = clip_rect();
+		entry.m_rects.clear();
+		entry.m_visible = true;
+		entry.m_used = true;
+
+		update_rects(entry);
+
+		return id;
+	}
+
+	void text_renderer::change(text_id id, float x, float y, color fill, GLuint z_index, clip_rect const &clip)
+	{
+		assert(id < m_texts.size() && m_texts[id].m_used);
+
+		text_entry &entry = m_texts[id];
+		entry.m_x = x;
+		entry.m_y = y;
+		entry.m_fill = fill;
+		entry.m_z_index = z_index;
+		entry.m_clip = clip;
+
+		update_rects(entry);
+	}
+
+	void text_renderer::visible(text_id id, bool visible)
+	{
+		assert(id < m_texts.size() && m_texts[id].m_used);
+
+		text_entry &entry = m_texts[id];
+		if(entry.m_visible != visible)
+		{
+			entry.m_visible = visible;
+			update_rects(entry);
+		}
+	}
+
+	void text_renderer::change_text(text_id id, char const *text)
+	{
+		assert(id < m_texts.size() && m_texts[id].m_used);
+
+		text_entry &entry = m_texts[id];
+		layout &old_layout = *entry.m_layout;
+		entry.m_layout = &get_layout(text, entry.m_font, entry.m_size);
+		release_layout(old_layout);
+
+		update_rects(entry);
+	}
+
+	void text_renderer::remove(text_id id)
+	{
+		assert(id < m_texts.size() && m_texts[id].m_used);
+
+		text_entry &entry = m_texts[id];
+		for(auto rect: entry.m_rects)
+			m_rects.remove(rect);
+		entry.m_rects.clear();
+		entry.m_used = false;
+
+		release_layout(*entry.m_layout);
+		entry.m_layout = nullptr;
+
+		m_free_ids.push_back(id);
+	}
+
+	float text_renderer::width(text_id id) const
+	{
+		assert(id < m_texts.size() && m_texts[id].m_used);
+		return m_texts[id].m_layout->m_width;
+	}
+
+	float text_renderer::height(text_id id) const
+	{
+		assert(id < m_texts.size() && m_texts[id].m_used);
+		return m_texts[id].m_layout->m_height;
+	}
+
+
+	//=============================================================================================
+	// Returns the cached layout for the given parameters or computes it. Every call adds a
+	// reference that has to be released with release_layout().
+	//=============================================================================================
+	text_renderer::layout& text_renderer::get_layout(char const *text, glyph_atlas::font_id font, float size)
+	{
+		layout_key key = {text, font, size};
+		auto it = m_layouts.find(key);
+		if(it != m_layouts.end())
+		{
+			++it->second.m_references;
+			return it->second;
+		}
+
+		it = m_layouts.insert(::std::make_pair(key, layout())).first;
+		layout &result = it->second;
+		result.m_width = 0;
+		result.m_references = 1;
+		result.m_key = &it->first;
+
+		float const scale = size / m_atlas.base_size();
+		float const line_height = m_atlas.line_height(font, size);
+		float const ascent = m_atlas.ascent(font, size);
+		float pen_x = 0, baseline = ascent;
+
+		while(*text)
+		{
+			uint code_point = next_code_point(text);
+			if(code_point == '\n')
+			{
+				pen_x = 0;
+				baseline += line_height;
+				continue;
+			}
+
+			glyph_atlas::glyph const &g = m_atlas.get(font, code_point);
+			if(g.texture_size[0] && g.texture_size[1])
+			{
+				rect_instance glyph_rect =
+				{
+					{pen_x + g.left * scale, baseline + g.top * scale},
+					{g.texture_size[0] * scale, g.texture_size[1] * scale},
+					{0, 0, 0, 0},
+					{0, 0, 0, 0},
+					0,
+					0,
+					0,
+					{g.texture_position[0], g.texture_position[1]},
+					{g.texture_size[0], g.texture_size[1]},
+					rect_glyph
+				};
+				result.m_glyphs.push_back(glyph_rect);
+			}
+
+			pen_x += g.advance * scale;
+			result.m_width = ::std::max(result.m_width, pen_x);
+		}
+
+		result.m_height = baseline - ascent + line_height;
+
+		return result;
+	}
+
+	void text_renderer::release_layout(layout &l)
+	{
+		assert(l.m_references > 0);
+
+		if(--l.m_references == 0)
+		{
+			// The key is part of the element that is erased, so it has to be copied
+			layout_key const key = *l.m_key;
+			m_layouts.erase(key);
+		}
+	}
+
+
+	//=============================================================================================
+	// Brings the text's rectangles in line with its layout and properties. Hidden texts have no
+	// rectangles at all.
+	//=============================================================================================
+	void text_renderer::update_rects(text_entry &entry)
+	{
+		size_t const num_glyphs = entry.m_visible ? entry.m_layout->m_glyphs.size() : 0;
+		while(entry.m_rects.size() > num_glyphs)
+		{
+			m_rects.remove(entry.m_rects.back());
+			entry.m_rects.pop_back();
+		}
+
+		for(size_t i = 0; i < num_glyphs; ++i)
+		{
+			rect_instance rect = entry.m_layout->m_glyphs[i];
+			rect.position[0] += entry.m_x;
+			rect.position[1] += entry.m_y;
+			rect.fill = entry.m_fill;
+			rect.z_index = entry.m_z_index;
+			rect.clip = entry.m_clip;
+
+			if(i < entry.m_rects.size())
+				m_rects.change(entry.m_rects[i], rect);
+			else
+				entry.m_rects.push_back(m_rects.add(rect));
+		}
+	}
+
+} // namespace: graf
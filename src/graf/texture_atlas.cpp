@@ -0,0 +1,230 @@
+/**************************************************************************************************
+ * graf library                                                                                   *
+ * Copyright © 2012 David Kretzmer                                                                *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction,including without limitation the rights to use, copy, modify, merge, publish,      *
+ * distribute,sublicense, and/or sell copies of the Software, and to permit persons to whom the   *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include <graf/texture_atlas.hpp>
+#include <graf/logger.hpp>
+
+#include <GL3/gl3w.h>
+
+#include <cassert>
+
+
+namespace graf
+{
+	//=============================================================================================
+	//
+	//=============================================================================================
+	texture_atlas::texture_atlas(uint size) :
+		m_size(size),
+		m_packer(size, size),
+		m_frame(0)
+	{
+		glGenTextures(1, &m_texture);
+		glBindTexture(GL_TEXTURE_2D, m_texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		glGenBuffers(1, &m_pixel_buffer);
+	}
+
+	texture_atlas::~texture_atlas()
+	{
+		glDeleteBuffers(1, &m_pixel_buffer);
+		glDeleteTextures(1, &m_texture);
+	}
+
+
+	//=============================================================================================
+	//
+	//=============================================================================================
+	texture_atlas::image_id texture_atlas::add(uint width, uint height, GLubyte const *pixels)
+	{
+		image_id id;
+		if(m_free_ids.empty())
+		{
+			id = m_images.size();
+			m_images.push_back(image());
+			m_images.back().m_generation = 0;
+		}
+		else
+		{
+			id = m_free_ids.back();
+			m_free_ids.pop_back();
+		}
+
+		image &img = m_images[id];
+		img.m_width = width;
+		img.m_height = height;
+		img.m_pixels.assign(pixels, pixels + width * height * 4);
+		img.m_shelf = not_resident;
+		img.m_used = true;
+		++img.m_generation;
+
+		return id;
+	}
+
+	void texture_atlas::remove(image_id id)
+	{
+		assert(id < m_images.size() && m_images[id].m_used);
+
+		// The space is reclaimed when its shelf is evicted
+		image &img = m_images[id];
+		img.m_pixels.clear();
+		img.m_shelf = not_resident;
+		img.m_used = false;
+
+		m_free_ids.push_back(id);
+	}
+
+
+	//=============================================================================================
+	// Returns the region of the given image, making room for it if necessary
+	//=============================================================================================
+	texture_atlas::region const& texture_atlas::use(image_id id)
+	{
+		assert(id < m_images.size() && m_images[id].m_used);
+
+		image &img = m_images[id];
+		if(img.m_shelf == not_resident && !place(img))
+		{
+			// Nothing is evicted if the image wouldn't fit anyway
+			::std::vector<bool> reclaimable(m_shelf_last_used.size());
+			for(uint shelf = 0; shelf < m_shelf_last_used.size(); ++shelf)
+				reclaimable[shelf] = m_shelf_last_used[shelf] != m_frame;
+
+			if(!m_packer.could_allocate(img.m_width + 1, img.m_height + 1, reclaimable))
+				throw light::runtime_error("Texture atlas is full");
+
+			while(img.m_shelf == not_resident)
+			{
+				if(!evict())
+					throw light::runtime_error("Texture atlas is full");
+				place(img);
+			}
+		}
+
+		m_shelf_last_used[img.m_shelf] = m_frame;
+
+		return img.m_region;
+	}
+
+
+	//=============================================================================================
+	// Uploads all images that have been placed since the last call. The pixels are copied into
+	// a freshly orphaned pixel buffer, so we never wait for the GPU to finish reading the last
+	// one, and glTexSubImage2D then reads from that buffer.
+	//=============================================================================================
+	void texture_atlas::flush()
+	{
+		if(m_uploads.empty())
+			return;
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pixel_buffer);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, m_staging.size(), m_staging.data(), GL_STREAM_DRAW);
+
+		glBindTexture(GL_TEXTURE_2D, m_texture);
+		for(auto const &up: m_uploads)
+		{
+			// Skip images that have been evicted or removed since they were queued
+			image const &img = m_images[up.m_image];
+			if(img.m_shelf == not_resident || img.m_generation != up.m_generation)
+				continue;
+
+			region const &r = img.m_region;
+			glTexSubImage2D(GL_TEXTURE_2D, 0, r.position[0], r.position[1], r.size[0], r.size[1],
+			                GL_RGBA, GL_UNSIGNED_BYTE, reinterpret_cast<void*>(up.m_offset));
+		}
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		m_uploads.clear();
+		m_staging.clear();
+	}
+
+	void texture_atlas::next_frame()
+	{
+		++m_frame;
+	}
+
+
+	//=============================================================================================
+	// Tries to find space for the given image and queues it for uploading
+	//=============================================================================================
+	bool texture_atlas::place(image &img)
+	{
+		// One texel of padding, so linear filtering doesn't pick up neighbouring images
+		uint x, y, shelf;
+		if(!m_packer.allocate(img.m_width + 1, img.m_height + 1, &x, &y, &shelf))
+			return false;
+
+		if(shelf >= m_shelf_last_used.size())
+			m_shelf_last_used.resize(shelf + 1, m_frame);
+
+		img.m_region.position[0] = GLushort(x);
+		img.m_region.position[1] = GLushort(y);
+		img.m_region.size[0] = GLushort(img.m_width);
+		img.m_region.size[1] = GLushort(img.m_height);
+		img.m_shelf = shelf;
+
+		upload up = {image_id(&img - m_images.data()), img.m_generation, m_staging.size()};
+		m_uploads.push_back(up);
+		m_staging.insert(m_staging.end(), img.m_pixels.begin(), img.m_pixels.end());
+
+		return true;
+	}
+
+
+	//=============================================================================================
+	// Evicts the least recently used shelf. Shelves used in the current frame are never
+	// evicted, since their images are displayed. Returns false if there is nothing to evict.
+	//=============================================================================================
+	bool texture_atlas::evict()
+	{
+		uint oldest = not_resident;
+		for(uint shelf = 0; shelf < m_shelf_last_used.size(); ++shelf)
+		{
+			if(m_shelf_last_used[shelf] != m_frame &&
+			   (oldest == not_resident || m_shelf_last_used[shelf] < m_shelf_last_used[oldest]))
+				oldest = shelf;
+		}
+
+		if(oldest == not_resident)
+			return false;
+
+		for(auto &img: m_images)
+		{
+			if(img.m_shelf == oldest)
+				img.m_shelf = not_resident;
+		}
+
+		m_packer.clear_shelf(oldest);
+		m_shelf_last_used[oldest] = m_frame;
+
+		// Empty shelves at the top have been merged into the free area
+		m_shelf_last_used.resize(m_packer.num_shelves());
+
+		return true;
+	}
+
+} // namespace: graf
@@ -54,11 +54,31 @@ namespace graf
 		return m_impl->process_events();
 	}
 
+	bool window::wait_events()
+	{
+		return m_impl->wait_events();
+	}
+
+	bool window::exposed()
+	{
+		return m_impl->exposed();
+	}
+
 	void window::swap_buffers()
 	{
 		m_impl->swap_buffers();
 	}
 
+	void window::swap_buffers(screen_rect const *regions, size_t num)
+	{
+		m_impl->swap_buffers(regions, num);
+	}
+
+	uint window::buffer_age()
+	{
+		return m_impl->buffer_age();
+	}
+
 	uint window::screen_width()
 	{
 		return m_impl->screen_width();
@@ -69,6 +89,16 @@ namespace graf
 		return m_impl->screen_height();
 	}
 
+	uint window::width()
+	{
+		return m_impl->width();
+	}
+
+	uint window::height()
+	{
+		return m_impl->height();
+	}
+
 	internal::window_impl* window::platform_impl()
 	{
 		return m_impl.get();
@@ -21,180 +21,949 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
 #include <vector>
 
-#include <light/utility/array_set.hpp>
+#include <light/light.hpp>
+#include <light/diagnostics/errors.hpp>
+
+#include "snapshot.hpp"
+
+
+template<typename THandle>
+class HandleTranslator;
 
 
 /// The Handle class represents a persistent index to an object in an array, even if objects
-/// are added or removed.
+/// are added or removed. Besides the index into the HandleTranslator it stores the generation of
+/// the translator's entry at the time the handle was created. Entries get a new generation when
+/// they are removed, so a handle to a removed object is detected instead of silently referring
+/// to whatever object reuses the entry. Only the HandleTranslator creates valid handles.
 template<typename T>
 class Handle
 {
-	static size_t const invalid_index = static_cast<size_t>(-1);
+	static light::uint4 const invalid_index = static_cast<light::uint4>(-1);
 
 public:
 	/// Indicates an invalid handle
 	static Handle const invalid;
 
-	/// Constructs a new handle
-	explicit Handle(size_t index = invalid_index) :
-		m_index(index) {}
+	/// Constructs an invalid handle
+	Handle() :
+		m_index(invalid_index),
+		m_generation(0) {}
 
-	bool operator == (Handle const &rhs) const { return m_index == rhs.m_index; }
-	bool operator != (Handle const &rhs) const { return m_index != rhs.m_index; }
+	bool operator == (Handle const &rhs) const { return m_index == rhs.m_index && m_generation == rhs.m_generation; }
+	bool operator != (Handle const &rhs) const { return !(*this == rhs); }
 
 	/// Gets the index
-	size_t index() const { return m_index; }
-	/// Sets the index
-	void index(size_t val) { m_index = val; }
+	light::uint4 index() const { return m_index; }
+	/// Gets the generation
+	light::uint4 generation() const { return m_generation; }
 	/// Checks whether the handle is valid
-	bool is_valid() const { return *this != invalid; }
+	bool is_valid() const { return m_index != invalid_index; }
 
 private:
-	size_t m_index;
+	friend class HandleTranslator<Handle>;
+
+	/// Constructs a handle to an entry of a HandleTranslator
+	Handle(light::uint4 index, light::uint4 generation) :
+		m_index(index),
+		m_generation(generation) {}
+
+	light::uint4 m_index;
+	light::uint4 m_generation;
 };
 
 template<typename T>
-Handle<T> const Handle<T>::invalid = Handle<T>(Handle<T>::invalid_index);
+Handle<T> const Handle<T>::invalid = Handle<T>();
+
+
+/// An entry of the HandleTranslator. While it is in use, m_index is the target index, otherwise
+/// it is the next entry of the free list. The generation is incremented whenever the entry is
+/// added or removed, so it is odd while the entry is in use. Handles are only created for
+/// entries in use, so a matching generation also means the entry is active.
+///
+/// Entries are stored in snapshots as they are, so changing them requires a new
+/// snapshot_version.
+struct HandleEntry
+{
+	light::uint4 m_index;
+	light::uint4 m_generation;
+};
+
+static_assert(sizeof(HandleEntry) == 8, "Handle entries are expected to be 8 bytes");
 
 
 /// The HandleTranslator converts persistent handle values into array indices which
 /// may change over time.
+///
+/// Entries are stored in fixed-size pages that are allocated when all existing entries are in
+/// use. Pages never move, so references to entries stay valid while the translator grows, and
+/// an empty translator doesn't allocate anything.
 template<typename THandle>
 class HandleTranslator
 {
 public:
 	typedef THandle HandleType;
 
-	/// Maximum number of objects the HandleConverter can handle
-	static size_t const max_entries = 1024;
+	/// Number of entries per page, a power of two
+	static size_t const page_size = 256;
 
 	/// Constructor
 	HandleTranslator() :
-		m_next_index(0)
-	{
-		for(size_t entry = 0; entry < max_entries; ++entry)
-		{
-			m_entries[entry].m_target_index = static_cast<size_t>(-1);
-			m_entries[entry].m_next_free_index = entry + 1;
-			m_entries[entry].m_active = false;
-		}
-	}
+		m_next_index(0) {}
 
 	/// Creates a new handle which points to the index target_index
 	HandleType add(size_t target_index)
 	{
-		assert(m_next_index < max_entries);
-		assert(m_entries[m_next_index].m_active == false);
+		assert(target_index < max_index);
+
+		if(m_next_index == capacity())
+			add_page();
 
-		m_entries[m_next_index].m_target_index = target_index;
-		m_entries[m_next_index].m_active = true;
+		entry &e = get_entry(m_next_index);
+		assert(!is_active(e));
 
-		HandleType new_handle(m_next_index);
-		m_next_index = m_entries[m_next_index].m_next_free_index;
+		light::uint4 const index = m_next_index;
+		m_next_index = e.m_index;
 
-		return new_handle;
+		e.m_index = light::uint4(target_index);
+		++e.m_generation;
+
+		return HandleType(index, e.m_generation);
 	}
 
-	/// Converts the specified handle to the corresponding array index
+	/// Converts the specified handle to the corresponding array index. Throws an exception if
+	/// the handle's object has been removed. The check is also done in release builds, since it
+	/// is only one compare.
 	size_t get(HandleType index) const
 	{
-		assert(index.index() < max_entries);
-		assert(m_entries[index.index()].m_active == true);
-
-		return m_entries[index.index()].m_target_index;
+		check(index);
+		return get_entry(index.index()).m_index;
 	}
 
 	/// Changes the index the specified handle points to (that's actually the one
 	/// and only purpose of this class)
 	void change(HandleType index, size_t new_target_index)
 	{
-		assert(index.index() < max_entries);
-		assert(m_entries[index.index()].m_active == true);
+		assert(new_target_index < max_index);
 
-		m_entries[index.index()].m_target_index = new_target_index;
+		check(index);
+		get_entry(index.index()).m_index = light::uint4(new_target_index);
 	}
 
-	/// Removes the specified handle from the list
+	/// Removes the specified handle from the list. All copies of the handle become stale.
 	void remove(HandleType index)
 	{
-		assert(index.index() < max_entries);
-		assert(m_entries[index.index()].m_active == true);
+		check(index);
 
-		m_entries[index.index()].m_target_index = static_cast<size_t>(-1);
-		m_entries[index.index()].m_next_free_index = m_next_index;
-		m_entries[index.index()].m_active = false;
+		entry &e = get_entry(index.index());
+		e.m_index = m_next_index;
+		++e.m_generation;
 
 		m_next_index = index.index();
 	}
 
+	/// Checks whether the handle refers to a live entry
+	bool contains(HandleType index) const
+	{
+		return index.index() < capacity() && is_active(get_entry(index.index())) &&
+		       get_entry(index.index()).m_generation == index.generation();
+	}
+
+	/// Returns the number of entries that can be used without allocating another page
+	size_t capacity() const { return m_pages.size() * page_size; }
+
+	/// Returns the head of the free list
+	light::uint4 next_free() const { return m_next_index; }
+
+	/// Writes all entries as a single snapshot section
+	void save(SnapshotWriter &out) const
+	{
+		out.begin_section(sizeof(entry), capacity());
+		for(auto const &page: m_pages)
+			out.write(page.get(), page_size * sizeof(entry));
+	}
+
+	/// Checks the entries of a snapshot section against the handles of the num_elements
+	/// elements saved with them. Every element's handle has to refer to an active entry that
+	/// points back at the element, no other entry may be active, and the free list has to link
+	/// all free entries and end after the last entry. Throws if anything doesn't match.
+	static void check_snapshot(SnapshotReader const &in, size_t section, HandleType const *handles, size_t num_elements)
+	{
+		size_t const num = in.count(section);
+		entry const *entries = in.section<entry>(section);
+		if(num % page_size || num > max_index)
+			throw light::runtime_error("Snapshot is corrupt");
+
+		size_t num_active = 0;
+		for(size_t i = 0; i < num; ++i)
+		{
+			if(is_active(entries[i]))
+			{
+				if(entries[i].m_index >= num_elements)
+					throw light::runtime_error("Snapshot is corrupt");
+				++num_active;
+			}
+		}
+		if(num_active != num_elements)
+			throw light::runtime_error("Snapshot is corrupt");
+
+		for(size_t i = 0; i < num_elements; ++i)
+		{
+			HandleType const h = handles[i];
+			if(h.index() >= num || entries[h.index()].m_generation != h.generation() ||
+			   !is_active(entries[h.index()]) || entries[h.index()].m_index != i)
+				throw light::runtime_error("Snapshot is corrupt");
+		}
+
+		// Counting the steps also catches cycles
+		size_t num_free = 0;
+		for(size_t next = in.next_handle(); next != num; next = entries[next].m_index)
+		{
+			if(next > num || is_active(entries[next]) || ++num_free > num - num_active)
+				throw light::runtime_error("Snapshot is corrupt");
+		}
+		if(num_free != num - num_active)
+			throw light::runtime_error("Snapshot is corrupt");
+	}
+
+	/// Replaces all entries with the ones of a snapshot section, which has to be checked with
+	/// check_snapshot() before
+	void load(SnapshotReader const &in, size_t section)
+	{
+		size_t const num = in.count(section);
+		entry const *entries = in.section<entry>(section);
+
+		std::vector<std::unique_ptr<entry[]>> pages(num / page_size);
+		for(size_t i = 0; i < pages.size(); ++i)
+		{
+			pages[i].reset(new entry[page_size]);
+			std::copy(entries + i * page_size, entries + (i + 1) * page_size, pages[i].get());
+		}
+
+		m_pages.swap(pages);
+		m_next_index = in.next_handle();
+	}
+
+	/// Allocates pages until there are entries for at least num handles
+	void reserve(size_t num)
+	{
+		assert(num <= max_index);
+
+		m_pages.reserve((num + page_size - 1) / page_size);
+		while(capacity() < num)
+			add_page();
+	}
+
+private:
+	static size_t const max_index = static_cast<light::uint4>(-1);
+
+	typedef HandleEntry entry;
+	std::vector<std::unique_ptr<entry[]>> m_pages;
+	light::uint4 m_next_index;
+
+	static bool is_active(entry const &e) { return e.m_generation & 1; }
+
+	entry& get_entry(size_t index)
+	{
+		return m_pages[index / page_size][index % page_size];
+	}
+
+	entry const& get_entry(size_t index) const
+	{
+		return m_pages[index / page_size][index % page_size];
+	}
+
+	/// Throws an exception if the given handle doesn't refer to a live entry
+	void check(HandleType index) const
+	{
+		if(index.index() >= capacity())
+			throw light::runtime_error("Invalid handle");
+		// Handles of active entries always have odd generations, so this also rejects handles
+		// that were never handed out by the translator
+		if(get_entry(index.index()).m_generation != index.generation() || !is_active(get_entry(index.index())))
+			throw light::runtime_error("Stale handle");
+	}
+
+	/// Adds a page of free entries. The free list always ends with the index capacity(), which
+	/// is the first entry of the new page, so the new entries are simply appended to it.
+	void add_page()
+	{
+		light::uint4 const first = light::uint4(capacity());
+		m_pages.push_back(std::unique_ptr<entry[]>(new entry[page_size]));
+
+		entry *page = m_pages.back().get();
+		for(light::uint4 i = 0; i < page_size; ++i)
+		{
+			page[i].m_index = first + i + 1;
+			page[i].m_generation = 0;
+		}
+	}
+};
+
+
+/// A set of bits that can quickly find the next set bit by scanning whole words
+class DirtyBits
+{
+public:
+	DirtyBits() :
+		m_size(0) {}
+
+	size_t size() const { return m_size; }
+
+	void reserve(size_t size)
+	{
+		m_words.reserve((size + word_bits - 1) / word_bits);
+	}
+
+	/// Changes the number of bits, new bits are cleared
+	void resize(size_t size)
+	{
+		m_words.resize((size + word_bits - 1) / word_bits, 0);
+		m_size = size;
+		clear_unused();
+	}
+
+	void set(size_t index)
+	{
+		assert(index < m_size);
+		m_words[index / word_bits] |= word(1) << (index % word_bits);
+	}
+
+	bool test(size_t index) const
+	{
+		assert(index < m_size);
+		return (m_words[index / word_bits] >> (index % word_bits)) & 1;
+	}
+
+	/// Sets the bits from begin to end, a word at a time
+	void set_range(size_t begin, size_t end)
+	{
+		assert(begin <= end && end <= m_size);
+
+		while(begin < end && begin % word_bits)
+			set(begin++);
+		for(; begin + word_bits <= end; begin += word_bits)
+			m_words[begin / word_bits] = ~word(0);
+		while(begin < end)
+			set(begin++);
+	}
+
+	void set_all()
+	{
+		std::fill(m_words.begin(), m_words.end(), ~word(0));
+		clear_unused();
+	}
+
+	void clear_all()
+	{
+		std::fill(m_words.begin(), m_words.end(), word(0));
+	}
+
+	/// Returns the index of the first set bit at or after from, or size() if there is none
+	size_t next(size_t from) const
+	{
+		if(from >= m_size)
+			return m_size;
+
+		size_t w = from / word_bits;
+		word bits = m_words[w] & (~word(0) << (from % word_bits));
+		while(!bits)
+		{
+			if(++w == m_words.size())
+				return m_size;
+			bits = m_words[w];
+		}
+
+		return w * word_bits + lowest_bit(bits);
+	}
+
 private:
-	struct entry
+	typedef std::uint64_t word;
+	static size_t const word_bits = 64;
+
+	std::vector<word> m_words;
+	size_t m_size;
+
+	/// Bits after the last one are always cleared, so next() never finds them
+	void clear_unused()
 	{
-		size_t m_target_index;
-		size_t m_next_free_index;
-		bool m_active;
+		if(m_size % word_bits)
+			m_words.back() &= ~(~word(0) << (m_size % word_bits));
+	}
+
+	static size_t lowest_bit(word bits)
+	{
+#if defined(__GNUC__)
+		return __builtin_ctzll(bits);
+#else
+		size_t index = 0;
+		while(!(bits & 1))
+		{
+			bits >>= 1;
+			++index;
+		}
+		return index;
+#endif
+	}
+};
+
+
+/// Size of a cache line in bytes
+static size_t const cache_line_size = 64;
+
+/// An allocator whose blocks start at a multiple of Alignment. Columns allocated with it start
+/// on a cache line, so scans over them never touch a partial line at the start and aligned SIMD
+/// loads can be used. Alignment has to be a power of two.
+template<typename T, size_t Alignment = cache_line_size>
+class AlignedAllocator
+{
+	static_assert(Alignment && !(Alignment & (Alignment - 1)), "Alignment has to be a power of two");
+	static_assert(Alignment >= sizeof(void*), "Alignment has to be at least the size of a pointer");
+
+public:
+	typedef T value_type;
+
+	template<typename U>
+	struct rebind
+	{
+		typedef AlignedAllocator<U, Alignment> other;
 	};
-	entry m_entries[max_entries];
-	size_t m_next_index;
+
+	AlignedAllocator() {}
+
+	template<typename U>
+	AlignedAllocator(AlignedAllocator<U, Alignment> const &) {}
+
+	/// Over-allocates by one alignment and stores the start of the actual block right in front
+	/// of the aligned one, so deallocate() can find it
+	T* allocate(size_t num)
+	{
+		if(num > (size_t(-1) - Alignment) / sizeof(T))
+			throw std::bad_alloc();
+
+		char *block = static_cast<char*>(::operator new(num * sizeof(T) + Alignment));
+		std::uintptr_t const aligned = (reinterpret_cast<std::uintptr_t>(block) + Alignment) & ~std::uintptr_t(Alignment - 1);
+		reinterpret_cast<void**>(aligned)[-1] = block;
+
+		return reinterpret_cast<T*>(aligned);
+	}
+
+	void deallocate(T *p, size_t)
+	{
+		::operator delete(reinterpret_cast<void**>(p)[-1]);
+	}
+
+	template<typename U>
+	bool operator == (AlignedAllocator<U, Alignment> const &) const { return true; }
+	template<typename U>
+	bool operator != (AlignedAllocator<U, Alignment> const &) const { return false; }
+};
+
+
+/// Returns the position of T in the list of types
+template<typename T, typename ...TTypes>
+struct ColumnIndex;
+
+template<typename T, typename ...TTypes>
+struct ColumnIndex<T, T, TTypes...>
+{
+	static size_t const value = 0;
+};
+
+template<typename T, typename TFirst, typename ...TTypes>
+struct ColumnIndex<T, TFirst, TTypes...>
+{
+	static size_t const value = 1 + ColumnIndex<T, TTypes...>::value;
+};
+
+
+/// A range of elements of several columns of a CatalogSet. The range is checked once when the
+/// view is created, after that elements are accessed through plain pointers, so loops over a
+/// view can be optimized like loops over arrays. Columns given as const types are read-only.
+///
+/// Views are invalidated by anything that moves elements, like adding or removing them.
+template<typename ...TColumns>
+class ZipView
+{
+public:
+	typedef std::tuple<TColumns&...> reference;
+
+	class iterator
+	{
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef std::tuple<TColumns...> value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef void pointer;
+		typedef ZipView::reference reference;
+
+		iterator(ZipView const *view, size_t index) :
+			m_view(view),
+			m_index(index) {}
+
+		reference operator * () const { return (*m_view)[m_index]; }
+
+		iterator& operator ++ () { ++m_index; return *this; }
+		iterator operator ++ (int) { iterator old = *this; ++m_index; return old; }
+
+		bool operator == (iterator const &rhs) const { return m_index == rhs.m_index; }
+		bool operator != (iterator const &rhs) const { return m_index != rhs.m_index; }
+
+		/// Returns the position in the view
+		size_t index() const { return m_index; }
+
+	private:
+		ZipView const *m_view;
+		size_t m_index;
+	};
+
+	/// The pointers point to the first element of the view in each column
+	ZipView(size_t size, TColumns *...columns) :
+		m_size(size),
+		m_columns(columns...) {}
+
+	size_t size() const { return m_size; }
+
+	iterator begin() const { return iterator(this, 0); }
+	iterator end() const { return iterator(this, m_size); }
+
+	/// Returns the values of the element at the given position in the view
+	reference operator [] (size_t i) const
+	{
+		assert(i < m_size);
+		return reference(column<TColumns>()[i]...);
+	}
+
+	/// Returns the value of column T of the element at the given position in the view
+	template<typename T>
+	T& get(size_t i) const
+	{
+		assert(i < m_size);
+		return column<T>()[i];
+	}
+
+	/// Returns the values of column T in this view as an array
+	template<typename T>
+	T* column() const
+	{
+		return std::get<ColumnIndex<T, TColumns...>::value>(m_columns);
+	}
+
+private:
+	size_t m_size;
+	std::tuple<TColumns*...> m_columns;
+};
+
+
+/// Checks whether values of all the types can be copied as plain bytes
+template<typename ...TTypes>
+struct AllTriviallyCopyable;
+
+template<>
+struct AllTriviallyCopyable<>
+{
+	static bool const value = true;
+};
+
+template<typename T, typename ...TTypes>
+struct AllTriviallyCopyable<T, TTypes...>
+{
+	static bool const value = std::is_trivially_copyable<T>::value && AllTriviallyCopyable<TTypes...>::value;
 };
 
 
 template<typename THandle, typename ...TValueTypes>
-class CatalogSet
+class CatalogSnapshot;
+
+
+/// Stores the values of its elements column by column, one vector per value type, and hands
+/// out handles that stay valid while elements are added, removed or reordered.
+///
+/// All columns are allocated with TAllocator, rebound to the column's value type. It can be
+/// any standard allocator, e.g. one that returns cache-line aligned blocks (the default, see
+/// CatalogSet), one that allocates from an arena or one that uses huge pages. Stateful
+/// allocators are passed to the constructor and copied into every column.
+template<typename THandle, typename TAllocator, typename ...TValueTypes>
+class BasicCatalogSet
 {
 public:
 	typedef THandle HandleType;
-	typedef light::array_set<TValueTypes...> CompoundType;
+	typedef TAllocator AllocatorType;
+	typedef CatalogSnapshot<THandle, TValueTypes...> SnapshotType;
+
+	/// The vector that stores the values of type T
+	template<typename T>
+	using ColumnType = std::vector<T, typename std::allocator_traits<TAllocator>::template rebind_alloc<T>>;
+
+	explicit BasicCatalogSet(TAllocator const &allocator = TAllocator()) :
+		m_elements(ColumnType<TValueTypes>(allocator)...),
+		m_num_dead(0),
+		m_layout_version(0)
+	{
+		std::fill(m_tracked, m_tracked + num_columns, false);
+	}
+
+	/// Allocates memory for num elements in every column, so that adding up to num elements
+	/// doesn't allocate anymore. Handles and bookkeeping are reserved as well.
+	void reserve(size_t num)
+	{
+		int expand[] = {0, (values<TValueTypes>().reserve(num), 0)...};
+		(void)expand;
+
+		m_handles.reserve(num);
+		m_index_to_handle.reserve(num);
+		m_dead.reserve(num);
+
+		for(size_t column = 0; column < num_columns; column++)
+			m_dirty[column].reserve(num);
+	}
 
 	HandleType add(TValueTypes const &...vals)
 	{
-		m_elements.add(vals...);
-		auto handle = m_handles.add(m_elements.size() - 1);
+		check_no_batch();
+
+		int expand[] = {0, (values<TValueTypes>().push_back(vals), 0)...};
+		(void)expand;
+		auto handle = m_handles.add(size() - 1);
 		m_index_to_handle.push_back(handle);
+		m_dead.push_back(false);
+		++m_layout_version;
+
+		for(size_t column = 0; column < num_columns; column++)
+		{
+			if(m_tracked[column])
+			{
+				m_dirty[column].resize(size());
+				m_dirty[column].set(size() - 1);
+			}
+		}
 
-		assert(m_elements.size() == m_index_to_handle.size());
+		assert(size() == m_index_to_handle.size());
 
 		return handle;
 	}
 
 	void add(size_t pos, size_t num, TValueTypes const *...vals, HandleType *handles)
 	{
-		assert(pos <= m_elements.size());
+		check_no_batch();
+		assert(pos <= size());
 		//assert((vals != nullptr)...);
 		assert(handles != nullptr);
 
 		// TODO: Think about exception safeness
-		m_elements.insert(pos, num, vals...);
+		int expand[] = {0, (values<TValueTypes>().insert(values<TValueTypes>().begin() + pos, vals, vals + num), 0)...};
+		(void)expand;
 
+		m_index_to_handle.insert(m_index_to_handle.begin() + pos, num, HandleType());
+		m_dead.insert(m_dead.begin() + pos, num, false);
 		for(size_t i = 0; i < num; i++)
 		{
 			handles[i] = m_handles.add(pos + i);
-			m_index_to_handle.insert(m_index_to_handle.begin() + pos + i, handles[i]);
+			m_index_to_handle[pos + i] = handles[i];
 		}
 
-		assert(m_elements.size() == m_index_to_handle.size());
+		assert(size() == m_index_to_handle.size());
 
 		// Update handles
-		for(size_t i = pos + num; i < m_elements.size(); i++)
+		for(size_t i = pos + num; i < size(); i++)
+			m_handles.change(m_index_to_handle[i], i);
+
+		indices_changed();
+	}
+
+	/// Queues an element to be inserted in front of the element that is at index pos before
+	/// the batch is committed. Elements queued for the same position keep their order. The
+	/// returned handle must not be used before commit_batch() is called. Until then, every
+	/// call that adds, removes or reorders elements throws.
+	HandleType batch_add(size_t pos, TValueTypes const &...vals)
+	{
+		assert(pos <= size());
+
+		int expand[] = {0, (batch_values<TValueTypes>().push_back(vals), 0)...};
+		(void)expand;
+		batch_entry entry = {pos, m_batch.size(), m_handles.add(0)};
+		m_batch.push_back(entry);
+
+		return entry.m_handle;
+	}
+
+	/// Inserts all queued elements. Every column is merged with its queued values in a single
+	/// pass and the handles are updated in a single sweep, so committing k elements into a
+	/// catalog of n elements costs O(n + k log k) instead of O(n * k).
+	void commit_batch()
+	{
+		if(m_batch.empty())
+			return;
+
+		std::stable_sort(m_batch.begin(), m_batch.end(), &batch_entry::by_position);
+
+		int expand[] = {0, (merge_column(values<TValueTypes>(), batch_values<TValueTypes>()), 0)...};
+		(void)expand;
+
+		std::vector<HandleType> handles(m_batch.size());
+		for(auto const &entry: m_batch)
+			handles[entry.m_value] = entry.m_handle;
+		merge_column(m_index_to_handle, handles);
+
+		std::vector<bool> dead;
+		dead.reserve(size());
+		size_t next = 0;
+		for(auto const &entry: m_batch)
+		{
+			for(; next < entry.m_pos; ++next)
+				dead.push_back(m_dead[next]);
+			dead.push_back(false);
+		}
+		for(; next < m_dead.size(); ++next)
+			dead.push_back(m_dead[next]);
+		m_dead.swap(dead);
+
+		assert(size() == m_index_to_handle.size());
+
+		for(size_t i = m_batch.front().m_pos; i < size(); i++)
+			m_handles.change(m_index_to_handle[i], i);
+
+		m_batch.clear();
+		m_batch_values = BatchType();
+
+		indices_changed();
+	}
+
+	/// Removes an element by moving the last element into its place. This is O(1), but
+	/// changes the order of the elements, so it is meant for catalogs whose order doesn't
+	/// matter.
+	void swap_remove(HandleType h)
+	{
+		check_no_batch();
+
+		size_t const index = m_handles.get(h);
+		size_t const last = size() - 1;
+
+		if(m_dead[index])
+			--m_num_dead;
+
+		if(index != last)
+		{
+			int expand[] = {0, (move_element(values<TValueTypes>(), last, index), 0)...};
+			(void)expand;
+
+			m_index_to_handle[index] = m_index_to_handle[last];
+			m_handles.change(m_index_to_handle[index], index);
+			m_dead[index] = m_dead[last];
+		}
+
+		int expand[] = {0, (values<TValueTypes>().pop_back(), 0)...};
+		(void)expand;
+		m_index_to_handle.pop_back();
+		m_dead.pop_back();
+
+		m_handles.remove(h);
+
+		indices_changed();
+	}
+
+	/// Removes num elements starting at index pos and keeps the order of the remaining ones.
+	/// Each column is compacted in a single pass and the handles of the following elements are
+	/// updated in a single sweep.
+	void erase(size_t pos, size_t num)
+	{
+		check_no_batch();
+		assert(pos + num <= size());
+
+		for(size_t i = pos; i < pos + num; i++)
+		{
+			m_handles.remove(m_index_to_handle[i]);
+			if(m_dead[i])
+				--m_num_dead;
+		}
+
+		int expand[] = {0, (erase_range(values<TValueTypes>(), pos, num), 0)...};
+		(void)expand;
+		erase_range(m_index_to_handle, pos, num);
+		erase_range(m_dead, pos, num);
+
+		for(size_t i = pos; i < size(); i++)
+			m_handles.change(m_index_to_handle[i], i);
+
+		indices_changed();
+	}
+
+	/// Marks an element as dead. It stays in the catalog and its handle stays valid until
+	/// compact() is called, so it is safe to do while iterating.
+	void mark_dead(HandleType h)
+	{
+		size_t const index = m_handles.get(h);
+		if(!m_dead[index])
+		{
+			m_dead[index] = true;
+			++m_num_dead;
+		}
+	}
+
+	bool is_dead(size_t index) const
+	{
+		assert(index < m_dead.size());
+		return m_dead[index];
+	}
+
+	size_t num_dead() const { return m_num_dead; }
+
+	/// Removes all dead elements, keeping the order of the remaining ones. Each column is
+	/// compacted in a single pass and the handles are updated in a single sweep, no matter
+	/// how many elements are removed.
+	void compact()
+	{
+		check_no_batch();
+
+		if(!m_num_dead)
+			return;
+
+		size_t first = 0;
+		while(!m_dead[first])
+			++first;
+
+		for(size_t i = first; i < m_dead.size(); i++)
+		{
+			if(m_dead[i])
+				m_handles.remove(m_index_to_handle[i]);
+		}
+
+		int expand[] = {0, (compact_column(values<TValueTypes>(), first), 0)...};
+		(void)expand;
+		compact_column(m_index_to_handle, first);
+
+		for(size_t i = first; i < m_index_to_handle.size(); i++)
+			m_handles.change(m_index_to_handle[i], i);
+
+		m_dead.assign(m_index_to_handle.size(), false);
+		m_num_dead = 0;
+
+		indices_changed();
+	}
+
+	/// Reorders the elements so that the element at index perm[i] moves to index i. All columns
+	/// are permuted in place by following the permutation's cycles and the handles are
+	/// updated in a single pass, so they stay valid.
+	void apply_permutation(std::vector<size_t> const &perm)
+	{
+		check_no_batch();
+		assert(perm.size() == size());
+
+		int expand[] = {0, (permute_column(values<TValueTypes>(), perm), 0)...};
+		(void)expand;
+		permute_column(m_index_to_handle, perm);
+		permute_column(m_dead, perm);
+
+		for(size_t i = 0; i < m_index_to_handle.size(); i++)
 			m_handles.change(m_index_to_handle[i], i);
+
+		indices_changed();
+	}
+
+	/// Stably sorts the elements by the values of column T
+	template<typename T, typename TCompare>
+	void sort_by(TCompare comp)
+	{
+		std::vector<size_t> perm(size());
+		for(size_t i = 0; i < perm.size(); i++)
+			perm[i] = i;
+
+		std::stable_sort(perm.begin(), perm.end(),
+		                 index_compare<T, TCompare>(values<T>(), comp));
+		apply_permutation(perm);
+	}
+
+	/// Writes all elements and handles to a snapshot file: one section per column, followed by
+	/// the handles of the elements and the entries of the handle translator. Handles stay
+	/// valid when the snapshot is loaded again. Dead elements have to be compacted and
+	/// batches committed before.
+	void save(char const *path) const
+	{
+		static_assert(AllTriviallyCopyable<TValueTypes...>::value, "Only catalogs of trivially copyable values can be saved");
+
+		if(m_num_dead || !m_batch.empty())
+			throw light::runtime_error("Catalog has to be compacted before it is saved");
+
+		SnapshotWriter out(path, num_sections);
+
+		int expand[] = {0, (save_column(out, values<TValueTypes>()), 0)...};
+		(void)expand;
+		save_column(out, m_index_to_handle);
+		m_handles.save(out);
+
+		out.finish(size(), m_handles.next_free());
+	}
+
+	void load(char const *path)
+	{
+		MappedFile file(path);
+		load(file);
+	}
+
+	/// Replaces all elements with the ones of a snapshot. Each column is copied in one go. All
+	/// sections are checked first, including that every handle resolves to its element, so a
+	/// broken snapshot throws and leaves the catalog as it is. Everything is marked as changed.
+	void load(MappedFile const &file)
+	{
+		check_no_batch();
+
+		SnapshotReader in(file, num_sections);
+		size_t const num = in.num_elements();
+
+		int check[] = {0, (check_section<TValueTypes>(in, column<TValueTypes>(), num), 0)...};
+		(void)check;
+		check_section<HandleType>(in, num_columns, num);
+		HandleTranslator<HandleType>::check_snapshot(in, num_columns + 1, in.section<HandleType>(num_columns), num);
+
+		m_handles.load(in, num_columns + 1);
+
+		int expand[] = {0, (load_column(in, column<TValueTypes>(), values<TValueTypes>()), 0)...};
+		(void)expand;
+		load_column(in, num_columns, m_index_to_handle);
+
+		m_dead.assign(num, false);
+		m_num_dead = 0;
+
+		indices_changed();
+	}
+
+	/// Checks whether the handle refers to an element of this catalog that hasn't been removed
+	bool contains(HandleType h) const
+	{
+		return m_handles.contains(h);
 	}
 
 	size_t size() const
 	{
-		return m_elements.size();
+		return std::get<0>(m_elements).size();
 	}
 
+	/// Changes whenever elements are added, removed or reordered, i.e. whenever an index
+	/// refers to a different element. Indices cached elsewhere are still valid as long as it
+	/// stays the same.
+	size_t layout_version() const { return m_layout_version; }
+
+	/// Returns the value of column T of the given element and marks it as changed
 	template<typename T>
 	T& get(HandleType h)
 	{
 		assert(h.is_valid());
 
 		auto index = m_handles.get(h);
-		assert(index < m_elements.size());
+		assert(index < size());
 
-		return m_elements.template array<T>()[index];
+		mark_dirty<T>(index);
+		return values<T>()[index];
 	}
 
 	template<typename T>
@@ -203,39 +972,117 @@ public:
 		assert(h.is_valid());
 
 		auto index = m_handles.get(h);
-		assert(index < m_elements.size());
+		assert(index < size());
 
-		return m_elements.template array<T>()[index];
+		return values<T>()[index];
 	}
 
 
+	/// Returns the value of column T of the element at the given index and marks it as changed
 	template<typename T>
 	T& at(size_t index)
 	{
-		assert(index < m_elements.size());
-		return m_elements.template array<T>()[index];
+		assert(index < size());
+
+		mark_dirty<T>(index);
+		return values<T>()[index];
 	}
 
 	template<typename T>
 	T const& at(size_t index) const
 	{
-		assert(index < m_elements.size());
-		return m_elements.template array<T>()[index];
+		assert(index < size());
+		return values<T>()[index];
+	}
+
+
+	/// Iterating with mutable iterators marks the whole column as changed
+	template<typename T>
+	typename ColumnType<T>::iterator begin()
+	{
+		if(m_tracked[column<T>()])
+			m_dirty[column<T>()].set_all();
+		return values<T>().begin();
+	}
+
+	template<typename T>
+	typename ColumnType<T>::iterator end()
+	{
+		return values<T>().end();
+	}
+
+	/// Returns a view of the given columns of all elements. Mutable columns are marked as
+	/// changed, columns given as const types, e.g. view<Base const, Position>(), are not.
+	template<typename ...TColumns>
+	ZipView<TColumns...> view()
+	{
+		return view<TColumns...>(0, size());
+	}
+
+	/// Returns a view of the given columns of the elements from begin to end
+	template<typename ...TColumns>
+	ZipView<TColumns...> view(size_t begin, size_t end)
+	{
+		assert(begin <= end && end <= size());
+		return ZipView<TColumns...>(end - begin, view_data<TColumns>(begin, end, std::is_const<TColumns>())...);
 	}
 
+	template<typename ...TColumns>
+	ZipView<TColumns const...> view(size_t begin, size_t end) const
+	{
+		assert(begin <= end && end <= size());
+		return ZipView<TColumns const...>(end - begin, (values<typename std::remove_const<TColumns>::type>().data() + begin)...);
+	}
+
+	/// Returns the values of column T, which is marked as changed as a whole
+	template<typename T>
+	T* data()
+	{
+		if(m_tracked[column<T>()])
+			m_dirty[column<T>()].set_all();
+		return values<T>().data();
+	}
+
+	template<typename T>
+	T const* data() const
+	{
+		return values<T>().data();
+	}
+
+
+	/// Starts tracking changes to column T. Afterwards, every element whose value of column T is
+	/// accessed mutably is marked as dirty until clear_dirty<T>() is called. Since indices
+	/// change when elements are inserted or removed out of order, all elements are marked
+	/// dirty then. Columns that aren't tracked are always dirty.
+	template<typename T>
+	void track_changes()
+	{
+		m_tracked[column<T>()] = true;
+		m_dirty[column<T>()].resize(size());
+		m_dirty[column<T>()].set_all();
+	}
 
 	template<typename T>
-	typename CompoundType::template vector_type<T>::iterator begin()
+	bool is_dirty(size_t index) const
 	{
-		return m_elements.template array<T>().begin();
+		return !m_tracked[column<T>()] || m_dirty[column<T>()].test(index);
 	}
 
+	/// Returns the index of the first dirty element at or after from, or size() if there is
+	/// none. Whole words of clean elements are skipped at once.
 	template<typename T>
-	typename CompoundType::template vector_type<T>::iterator end()
+	size_t next_dirty(size_t from) const
 	{
-		return m_elements.template array<T>().end();
+		if(!m_tracked[column<T>()])
+			return std::min(from, size());
+		return m_dirty[column<T>()].next(from);
 	}
 
+	template<typename T>
+	void clear_dirty()
+	{
+		m_dirty[column<T>()].clear_all();
+	}
 
 	size_t get_index(HandleType h) const { return m_handles.get(h); }
 	HandleType get_handle(size_t index) const
@@ -245,7 +1092,289 @@ public:
 	}
 
 private:
+	/// An element queued by batch_add()
+	struct batch_entry
+	{
+		/// The index the element is inserted at
+		size_t m_pos;
+		/// The element's index in m_batch_values
+		size_t m_value;
+		HandleType m_handle;
+
+		static bool by_position(batch_entry const &lhs, batch_entry const &rhs) { return lhs.m_pos < rhs.m_pos; }
+	};
+
 	HandleTranslator<HandleType> m_handles;
-	CompoundType m_elements;
+	std::tuple<ColumnType<TValueTypes>...> m_elements;
 	std::vector<HandleType> m_index_to_handle;
+
+	/// Tombstones of elements that are removed by the next compact()
+	std::vector<bool> m_dead;
+	size_t m_num_dead;
+
+	static size_t const num_columns = sizeof...(TValueTypes);
+
+	size_t m_layout_version;
+
+	/// Snapshots store the columns, the handles of the elements and the translator's entries
+	static size_t const num_sections = num_columns + 2;
+
+	/// Changed elements per column, only maintained for tracked columns
+	DirtyBits m_dirty[num_columns];
+	bool m_tracked[num_columns];
+
+	template<typename T>
+	static size_t column() { return ColumnIndex<T, TValueTypes...>::value; }
+
+	template<typename T>
+	void mark_dirty(size_t index)
+	{
+		if(m_tracked[column<T>()])
+			m_dirty[column<T>()].set(index);
+	}
+
+	/// Queued elements are inserted at positions that refer to the current layout and their
+	/// handles point at placeholders, so nothing may move elements until the batch is committed
+	void check_no_batch() const
+	{
+		if(!m_batch.empty())
+			throw light::runtime_error("Catalog has an uncommitted batch");
+	}
+
+	/// Read-only columns of a view are not marked
+	template<typename T>
+	T* view_data(size_t begin, size_t, std::true_type)
+	{
+		return values<typename std::remove_const<T>::type>().data() + begin;
+	}
+
+	template<typename T>
+	T* view_data(size_t begin, size_t end, std::false_type)
+	{
+		if(m_tracked[column<T>()])
+			m_dirty[column<T>()].set_range(begin, end);
+		return values<T>().data() + begin;
+	}
+
+	/// Elements have moved, so everything is dirty
+	void indices_changed()
+	{
+		++m_layout_version;
+
+		for(size_t column = 0; column < num_columns; column++)
+		{
+			if(m_tracked[column])
+			{
+				m_dirty[column].resize(size());
+				m_dirty[column].set_all();
+			}
+		}
+	}
+
+	std::vector<batch_entry> m_batch;
+
+	/// Values queued by batch_add(), they are only kept until the batch is committed
+	typedef std::tuple<std::vector<TValueTypes>...> BatchType;
+	BatchType m_batch_values;
+
+	template<typename T>
+	ColumnType<T>& values() { return std::get<ColumnIndex<T, TValueTypes...>::value>(m_elements); }
+	template<typename T>
+	ColumnType<T> const& values() const { return std::get<ColumnIndex<T, TValueTypes...>::value>(m_elements); }
+
+	template<typename T>
+	std::vector<T>& batch_values() { return std::get<ColumnIndex<T, TValueTypes...>::value>(m_batch_values); }
+
+	template<typename T, typename TAlloc>
+	static void save_column(SnapshotWriter &out, std::vector<T, TAlloc> const &column)
+	{
+		out.begin_section(sizeof(T), column.size());
+		if(!column.empty())
+			out.write(column.data(), column.size() * sizeof(T));
+	}
+
+	template<typename T>
+	static void check_section(SnapshotReader const &in, size_t section, size_t num)
+	{
+		in.section<T>(section);
+		if(in.count(section) != num)
+			throw light::runtime_error("Snapshot is corrupt");
+	}
+
+	template<typename T, typename TAlloc>
+	static void load_column(SnapshotReader const &in, size_t section, std::vector<T, TAlloc> &column)
+	{
+		T const *data = in.section<T>(section);
+		column.assign(data, data + in.count(section));
+	}
+
+	template<typename T, typename TAlloc>
+	static void move_element(std::vector<T, TAlloc> &column, size_t from, size_t to)
+	{
+		column[to] = std::move(column[from]);
+	}
+
+	template<typename T, typename TAlloc>
+	static void erase_range(std::vector<T, TAlloc> &column, size_t pos, size_t num)
+	{
+		column.erase(column.begin() + pos, column.begin() + pos + num);
+	}
+
+	/// Compares indices by the values they refer to
+	template<typename T, typename TCompare>
+	struct index_compare
+	{
+		index_compare(ColumnType<T> const &column, TCompare comp) :
+			m_column(column),
+			m_comp(comp) {}
+
+		bool operator () (size_t lhs, size_t rhs) const { return m_comp(m_column[lhs], m_column[rhs]); }
+
+		ColumnType<T> const &m_column;
+		TCompare m_comp;
+	};
+
+	template<typename T, typename TAlloc>
+	static void permute_column(std::vector<T, TAlloc> &column, std::vector<size_t> const &perm)
+	{
+		std::vector<bool> done(perm.size());
+		for(size_t start = 0; start < perm.size(); start++)
+		{
+			if(done[start] || perm[start] == start)
+				continue;
+
+			T first = std::move(column[start]);
+			size_t cur = start;
+			while(perm[cur] != start)
+			{
+				column[cur] = std::move(column[perm[cur]]);
+				done[cur] = true;
+				cur = perm[cur];
+			}
+			column[cur] = std::move(first);
+			done[cur] = true;
+		}
+	}
+
+	/// Moves the elements that are alive to the front, starting at the first dead element
+	template<typename T, typename TAlloc>
+	void compact_column(std::vector<T, TAlloc> &column, size_t first) const
+	{
+		size_t out = first;
+		for(size_t i = first; i < column.size(); i++)
+		{
+			if(!m_dead[i])
+				column[out++] = std::move(column[i]);
+		}
+		column.erase(column.begin() + out, column.end());
+	}
+
+	/// Merges the queued values into the column, m_batch has to be sorted by position
+	template<typename T, typename TAlloc>
+	void merge_column(std::vector<T, TAlloc> &column, std::vector<T> const &values) const
+	{
+		std::vector<T, TAlloc> merged(column.get_allocator());
+		merged.reserve(column.size() + m_batch.size());
+
+		size_t next = 0;
+		for(auto const &entry: m_batch)
+		{
+			merged.insert(merged.end(), std::make_move_iterator(column.begin() + next),
+			              std::make_move_iterator(column.begin() + entry.m_pos));
+			merged.push_back(values[entry.m_value]);
+			next = entry.m_pos;
+		}
+		merged.insert(merged.end(), std::make_move_iterator(column.begin() + next),
+		              std::make_move_iterator(column.end()));
+
+		column.swap(merged);
+	}
+};
+
+
+/// A catalog whose columns start on cache lines
+template<typename THandle, typename ...TValueTypes>
+using CatalogSet = BasicCatalogSet<THandle, AlignedAllocator<char>, TValueTypes...>;
+
+
+/// A snapshot that is used in place: values are read directly from the file, nothing is
+/// copied, so even huge snapshots are available right away, e.g. for crash analysis. The
+/// file has to outlive the snapshot. Handles resolve to the same elements as in the catalog
+/// that was saved.
+template<typename THandle, typename ...TValueTypes>
+class CatalogSnapshot
+{
+public:
+	typedef THandle HandleType;
+
+	explicit CatalogSnapshot(MappedFile const &file) :
+		m_reader(file, num_columns + 2),
+		m_size(m_reader.num_elements()),
+		m_columns(m_reader.template section<TValueTypes>(ColumnIndex<TValueTypes, TValueTypes...>::value)...),
+		m_index_to_handle(m_reader.template section<HandleType>(num_columns)),
+		m_entries(m_reader.template section<HandleEntry>(num_columns + 1)),
+		m_num_entries(m_reader.count(num_columns + 1))
+	{
+		for(size_t section = 0; section <= num_columns; section++)
+		{
+			if(m_reader.count(section) != m_size)
+				throw light::runtime_error("Snapshot is corrupt");
+		}
+	}
+
+	size_t size() const { return m_size; }
+
+	template<typename T>
+	T const& at(size_t index) const
+	{
+		assert(index < m_size);
+		return column<T>()[index];
+	}
+
+	template<typename T>
+	T const& get(HandleType h) const
+	{
+		return column<T>()[get_index(h)];
+	}
+
+	/// Returns a view of the given columns of the elements from begin to end
+	template<typename ...TColumns>
+	ZipView<TColumns const...> view(size_t begin, size_t end) const
+	{
+		assert(begin <= end && end <= m_size);
+		return ZipView<TColumns const...>(end - begin, (column<typename std::remove_const<TColumns>::type>() + begin)...);
+	}
+
+	/// Throws like HandleTranslator if the handle doesn't refer to an element
+	size_t get_index(HandleType h) const
+	{
+		if(h.index() >= m_num_entries)
+			throw light::runtime_error("Invalid handle");
+		if(m_entries[h.index()].m_generation != h.generation() || !(h.generation() & 1))
+			throw light::runtime_error("Stale handle");
+
+		size_t const index = m_entries[h.index()].m_index;
+		if(index >= m_size)
+			throw light::runtime_error("Snapshot is corrupt");
+		return index;
+	}
+
+	HandleType get_handle(size_t index) const
+	{
+		assert(index < m_size);
+		return m_index_to_handle[index];
+	}
+
+private:
+	static size_t const num_columns = sizeof...(TValueTypes);
+
+	SnapshotReader m_reader;
+	size_t m_size;
+	std::tuple<TValueTypes const*...> m_columns;
+	HandleType const *m_index_to_handle;
+	HandleEntry const *m_entries;
+	size_t m_num_entries;
+
+	template<typename T>
+	T const* column() const { return std::get<ColumnIndex<T, TValueTypes...>::value>(m_columns); }
 };
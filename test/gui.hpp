@@ -22,10 +22,24 @@
 #pragma once
 
 #include <light/string/string.hpp>
+#include <graf/opengl.hpp>
+#include <graf/rect_renderer.hpp>
+#include <graf/text_renderer.hpp>
+#include <graf/texture_atlas.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "red/static_vector.hpp"
 #include "red/vector_operations.hpp"
 
+#include "parallel.hpp"
+
 
 //=================================================================================================
 //
@@ -56,8 +70,32 @@ public:
 		light::uint4 m_depth;
 		light::uint4 m_world_z_index;
 	};
+	struct Clip
+	{
+		/// Whether the element's children are clipped to its bounding box
+		bool m_clips_children;
+		/// The area the element is clipped to, i.e. the viewport intersected with the bounding
+		/// boxes of all clipping ancestors
+		red::vector2f m_world_clip_position;
+		red::vector2f m_world_clip_size;
+		/// Whether any part of the element lies inside its clip area
+		bool m_visible;
+	};
+
+	typedef CatalogSet<HandleType, Base, Position, ZData, Clip> CatalogType;
 
-	typedef CatalogSet<HandleType, Base, Position, ZData> CatalogType;
+	SpatialCatalog(red::vector2f viewport) :
+		m_viewport(viewport),
+		m_viewport_changed(true),
+		m_version(0),
+		m_changed_version(0),
+		m_batching(false),
+		m_batch_begin(0)
+	{
+		m_spatials.track_changes<Position>();
+		m_spatials.track_changes<ZData>();
+		m_spatials.track_changes<Clip>();
+	}
 
 
 	HandleType add(HandleType parent, red::vector2f const pos, red::vector2f const &bbox, light::uint4 depth = 5)
@@ -67,26 +105,238 @@ public:
 		Base base = {parent, last_child(parent), HandleType()};
 		Position spos = {pos, bbox, red::vector2f()};
 		ZData z_index = {1, depth, 0};
+		Clip clip = {false, red::vector2f(), red::vector2f(), true};
 
-		// Compute insert position
-		HandleType last_element = parent;
-		HandleType cur;
-		while((cur = last_child(last_element)).is_valid())
-			last_element = cur;
-		size_t insert_pos = last_element.is_valid() ? m_spatials.get_index(last_element) + 1 : 0;
+		if(m_batching)
+		{
+			// Queued elements are appended and put in place by commit_batch()
+			handle = m_spatials.add(base, spos, z_index, clip);
 
-		m_spatials.add(insert_pos, 1, &base, &spos, &z_index, &handle);
+			QueuedChildren &queued = m_queued_children[batch_key(parent)];
+			if(!queued.m_first.is_valid())
+				queued.m_first = handle;
+			queued.m_last = handle;
+		}
+		else
+		{
+			// The new element becomes the parent's last descendant
+			size_t insert_pos = parent.is_valid() ? subtree_end(parent) : m_spatials.size();
+			m_spatials.add(insert_pos, 1, &base, &spos, &z_index, &clip, &handle);
+		}
+		++m_version;
 		if(base.m_predecessor.is_valid())
 			get<Base>(base.m_predecessor).m_successor = handle;
 
 		return handle;
 	}
 
-	/// Updates position and and z-order of all elements
+	/// Removes the given element and all of its descendants. They are only marked as dead
+	/// and unlinked from their siblings; compact() removes them from the catalog. Until then
+	/// their handles stay valid, so it is safe to remove elements while iterating.
+	void remove(HandleType h)
+	{
+		check_no_batch();
+
+		size_t const index = get_index(h);
+		size_t const end = subtree_end(h);
+
+		Base const base = get<Base>(h);
+		if(base.m_predecessor.is_valid())
+			get<Base>(base.m_predecessor).m_successor = base.m_successor;
+		if(base.m_successor.is_valid())
+			get<Base>(base.m_successor).m_predecessor = base.m_predecessor;
+
+		for(size_t i = index; i < end; ++i)
+			m_spatials.mark_dead(m_spatials.get_handle(i));
+	}
+
+	/// Removes all dead elements in a single pass
+	void compact()
+	{
+		check_no_batch();
+
+		m_spatials.compact();
+		++m_version;
+	}
+
+	/// Starts a batch. Elements added until commit_batch() are appended instead of being
+	/// inserted behind their parent's subtree, which would move all following elements, so
+	/// building a tree of n elements costs O(n) instead of O(n^2). Their handles can be used
+	/// right away, but update(), remove(), compact(), save() and load() throw until the batch
+	/// is committed. Does nothing if a batch is open already.
+	void begin_batch()
+	{
+		if(!m_batching)
+		{
+			m_batching = true;
+			m_batch_begin = m_spatials.size();
+		}
+	}
+
+	bool batching() const { return m_batching; }
+
+	/// Moves the elements added since begin_batch() behind their parent's subtree with a
+	/// single permutation of the catalog, in the order a tree built without a batch would
+	/// have. Returns the permutation that has been applied, see
+	/// CatalogSet::apply_permutation(), so data stored in the same order can follow. It is
+	/// empty if all elements are in place already.
+	std::vector<size_t> const& commit_batch()
+	{
+		m_permutation.clear();
+		if(!m_batching)
+			return m_permutation;
+
+		// Elements queued for committed parents go to the end of the parent's subtree. If the
+		// subtrees of several parents end at the same index, the parents are nested, so the
+		// children of the deepest one come first.
+		std::vector<QueuedSubtree> subtrees;
+		for(auto const &queued: m_queued_children)
+		{
+			if(queued.first == no_parent())
+			{
+				QueuedSubtree roots = {m_batch_begin, 0, queued.second.m_first};
+				subtrees.push_back(roots);
+			}
+			else if(queued.first < m_batch_begin)
+			{
+				HandleType const parent = get_handle(queued.first);
+				QueuedSubtree subtree = {subtree_end(parent), depth(parent), queued.second.m_first};
+				subtrees.push_back(subtree);
+			}
+		}
+		std::sort(subtrees.begin(), subtrees.end(), &QueuedSubtree::by_position);
+
+		m_permutation.reserve(m_spatials.size());
+		auto subtree = subtrees.begin();
+		for(size_t i = 0; i <= m_batch_begin; ++i)
+		{
+			for(; subtree != subtrees.end() && subtree->m_pos == i; ++subtree)
+				append_queued(subtree->m_first);
+			if(i < m_batch_begin)
+				m_permutation.push_back(i);
+		}
+		assert(m_permutation.size() == m_spatials.size());
+
+		m_batching = false;
+		m_queued_children.clear();
+
+		bool in_place = true;
+		for(size_t i = 0; i < m_permutation.size() && in_place; ++i)
+			in_place = m_permutation[i] == i;
+
+		if(in_place)
+			m_permutation.clear();
+		else
+		{
+			m_spatials.apply_permutation(m_permutation);
+			++m_version;
+		}
+
+		return m_permutation;
+	}
+
+	/// Changes whenever elements are added or removed, i.e. whenever indices change
+	size_t version() const { return m_version; }
+
+	/// Writes all spatials to a snapshot file, see CatalogSet::save(). Removed spatials have to
+	/// be compacted before.
+	void save(char const *path) const
+	{
+		check_no_batch();
+		m_spatials.save(path);
+	}
+
+	/// Replaces all spatials with the ones of a snapshot. Handles to spatials that were saved
+	/// stay valid, and everything is updated again on the next update().
+	///
+	/// Only meant for a standalone catalog: catalogs that are indexed like the spatials, like
+	/// InputCatalog, or that store spatial handles, like the ones of GuiMananger, are not part of
+	/// the snapshot and would no longer match the loaded spatials.
+	void load(char const *path)
+	{
+		check_no_batch();
+		m_spatials.load(path);
+		++m_version;
+		m_viewport_changed = true;
+	}
+
+	bool is_dead(size_t index) const { return m_spatials.is_dead(index); }
+	size_t num_dead() const { return m_spatials.num_dead(); }
+
+	/// Returns the index after the last descendant of the given element. During a batch,
+	/// queued elements are not part of any subtree yet.
+	size_t subtree_end(HandleType h) const
+	{
+		// Queued siblings always follow the committed ones, so they are skipped by stopping at
+		// the first queued index
+		size_t const end = m_batching ? m_batch_begin : m_spatials.size();
+
+		// Elements are stored depth-first, so the subtree ends at the next sibling of the
+		// element or of its closest ancestor that has one
+		for(HandleType cur = h; cur.is_valid(); cur = get<Base>(cur).m_parent)
+		{
+			HandleType next = get<Base>(cur).m_successor;
+			if(next.is_valid() && get_index(next) < end)
+				return get_index(next);
+		}
+
+		return end;
+	}
+
+	/// Checks whether the element exists, i.e. hasn't been removed
+	bool contains(HandleType h) const
+	{
+		return m_spatials.contains(h);
+	}
+
+	/// Updates position, z-order and visibility of the elements that have changed since the
+	/// last update. An element's world position and clip area depend on its ancestors, so a
+	/// changed element is updated together with its subtree; all other elements are skipped.
 	void update()
 	{
-		update_z();
-		update_position();
+		check_no_batch();
+
+		m_changed.resize(m_spatials.size());
+		m_changed.clear_all();
+		m_changed_version = m_version;
+
+		if(m_spatials.next_dirty<ZData>(0) < m_spatials.size())
+			update_z();
+
+		size_t index = m_viewport_changed ? 0 : next_changed(0);
+		while(index < m_spatials.size())
+		{
+			size_t const end = m_viewport_changed ? m_spatials.size() : subtree_end(m_spatials.get_handle(index));
+
+			// update_position() marks the range as changed, which doesn't matter since the
+			// search continues after it
+			update_position(index, end);
+			for(size_t i = index; i < end; ++i)
+				update_clip(i);
+			m_changed.set_range(index, end);
+
+			index = next_changed(end);
+		}
+
+		m_viewport_changed = false;
+		m_spatials.clear_dirty<Position>();
+		m_spatials.clear_dirty<ZData>();
+		m_spatials.clear_dirty<Clip>();
+	}
+
+	/// Returns whether the world position, z-index or clip area of the element at the given
+	/// index has changed in the last update
+	bool changed(size_t index) const
+	{
+		// If elements have been added or removed since, indices don't match anymore
+		return m_changed_version != m_version || index >= m_changed.size() || m_changed.test(index);
+	}
+
+	/// Sets the size of the viewport. Elements outside of it are not visible.
+	void viewport(red::vector2f size)
+	{
+		m_viewport = size;
+		m_viewport_changed = true;
 	}
 
 	/// Returns the first child of the given element. If it has no children, an
@@ -97,12 +347,9 @@ public:
 
 		if(parent.is_valid())
 		{
-			auto child_index = m_spatials.get_index(parent) + 1;
+			size_t const child_index = first_child_index(parent);
 			if(child_index < m_spatials.size())
-			{
-				if(m_spatials.at<Base>(child_index).m_parent == parent)
-					first = m_spatials.get_handle(child_index);
-			}
+				first = m_spatials.get_handle(child_index);
 		}
 
 		return first;
@@ -112,12 +359,24 @@ public:
 	/// invalid handle is returned
 	HandleType last_child(HandleType parent)
 	{
+		if(m_batching)
+		{
+			auto queued = m_queued_children.find(batch_key(parent));
+			if(queued != m_queued_children.end())
+				return queued->second.m_last;
+		}
+
 		HandleType last;
-		auto array_size = m_spatials.size();
-		size_t current = parent.is_valid() ? m_spatials.get_index(parent) + 1 : 0;
+		size_t const first = first_child_index(parent);
 
-		while(current < array_size && m_spatials.at<Base>(current).m_parent == parent)
-			last = m_spatials.get_handle(current++);
+		// Children are not stored next to each other if they have children themselves, so
+		// follow the sibling links
+		if(first < m_spatials.size())
+		{
+			last = m_spatials.get_handle(first);
+			while(get<Base>(last).m_successor.is_valid())
+				last = get<Base>(last).m_successor;
+		}
 
 		return last;
 	}
@@ -125,14 +384,7 @@ public:
 	/// Returns whether the given element has children or not
 	bool has_children(HandleType h)
 	{
-		if(h.is_valid())
-		{
-			size_t child_index = m_spatials.get_index(h) + 1;
-			if(child_index < m_spatials.size())
-				return m_spatials.at<Base>(child_index).m_parent == h;
-		}
-
-		return false;
+		return h.is_valid() && first_child_index(h) < m_spatials.size();
 	}
 
 	template<typename T>
@@ -159,6 +411,13 @@ public:
 		return m_spatials.at<T>(i);
 	}
 
+	/// Returns a read-only view of the given columns of the elements from begin to end
+	template<typename ...TColumns>
+	ZipView<TColumns const...> view(size_t begin, size_t end) const
+	{
+		return m_spatials.view<TColumns...>(begin, end);
+	}
+
 
 	size_t get_index(HandleType h) const
 	{
@@ -172,27 +431,175 @@ public:
 
 private:
 	CatalogType m_spatials;
+	red::vector2f m_viewport;
+	bool m_viewport_changed;
+	size_t m_version;
+
+	/// The elements that have changed in the last update and the version they refer to
+	DirtyBits m_changed;
+	size_t m_changed_version;
+
+	/// The first and the last child that has been queued for an element in the current batch
+	struct QueuedChildren
+	{
+		HandleType m_first;
+		HandleType m_last;
+	};
+
+	/// Children queued for a committed parent, which are inserted at the parent's subtree end
+	struct QueuedSubtree
+	{
+		size_t m_pos;
+		size_t m_depth;
+		HandleType m_first;
+
+		static bool by_position(QueuedSubtree const &lhs, QueuedSubtree const &rhs)
+		{
+			return lhs.m_pos < rhs.m_pos || (lhs.m_pos == rhs.m_pos && lhs.m_depth > rhs.m_depth);
+		}
+	};
+
+	/// Elements before m_batch_begin are in place, the ones after it have been queued. Indices
+	/// don't change during a batch, so the queued children are looked up by their parent's index.
+	bool m_batching;
+	size_t m_batch_begin;
+	std::unordered_map<size_t, QueuedChildren> m_queued_children;
+	std::vector<size_t> m_permutation;
+
+	void check_no_batch() const
+	{
+		if(m_batching)
+			throw light::runtime_error("Catalog has an uncommitted batch");
+	}
+
+	/// The key of root elements in m_queued_children
+	static size_t no_parent() { return std::numeric_limits<size_t>::max(); }
+
+	size_t batch_key(HandleType parent) const
+	{
+		return parent.is_valid() ? get_index(parent) : no_parent();
+	}
+
+	/// Returns the number of ancestors of the given element plus one, or 0 for no element
+	size_t depth(HandleType h) const
+	{
+		size_t result = 0;
+		for(; h.is_valid(); h = get<Base>(h).m_parent)
+			++result;
+		return result;
+	}
+
+	/// Appends the given queued element, its queued siblings behind it and all of their queued
+	/// descendants to m_permutation in depth-first order
+	void append_queued(HandleType first)
+	{
+		CatalogType const &spatials = m_spatials;
+		for(HandleType cur = first; cur.is_valid(); cur = spatials.get<Base>(cur).m_successor)
+		{
+			size_t const index = get_index(cur);
+			m_permutation.push_back(index);
+
+			auto queued = m_queued_children.find(index);
+			if(queued != m_queued_children.end())
+				append_queued(queued->second.m_first);
+		}
+	}
+
+	/// Returns the index of the first child of the given element, or of the first root element
+	/// if parent is invalid. Returns size() if there is none. Removed elements stay in place
+	/// until compact(), but their links are outdated, so they are skipped. Removed elements
+	/// right after the parent can only be its descendants, and a live child follows them.
+	size_t first_child_index(HandleType parent) const
+	{
+		size_t index = parent.is_valid() ? m_spatials.get_index(parent) + 1 : 0;
+		while(index < m_spatials.size() && m_spatials.is_dead(index))
+			++index;
+
+		if(index < m_spatials.size() && m_spatials.at<Base>(index).m_parent == parent)
+			return index;
+
+		// Children queued for a committed parent are appended behind other elements
+		if(m_batching)
+		{
+			auto queued = m_queued_children.find(batch_key(parent));
+			if(queued != m_queued_children.end())
+				return get_index(queued->second.m_first);
+		}
+
+		return m_spatials.size();
+	}
 
-	void update_position()
+	/// Returns the index of the next element at or after from whose position, bounding box or
+	/// clipping has been changed
+	size_t next_changed(size_t from) const
 	{
-		for(size_t i = 0; i < m_spatials.size(); ++i)
+		return std::min(m_spatials.next_dirty<Position>(from), m_spatials.next_dirty<Clip>(from));
+	}
+
+	/// Parents always come before their children, so their world positions are already up to
+	/// date when a child is reached
+	void update_position(size_t begin, size_t end)
+	{
+		CatalogType const &spatials = m_spatials;
+		auto view = m_spatials.view<Base const, Position>(begin, end);
+
+		for(size_t i = 0; i < view.size(); ++i)
 		{
-			auto &spatial = m_spatials.at<Position>(i);
-			auto &base = m_spatials.at<Base>(i);
+			Base const &base = view.get<Base const>(i);
+			Position &spatial = view.get<Position>(i);
 
 			if(base.m_parent.is_valid())
-				spatial.m_world_position = spatial.m_position + m_spatials.get<Position>(base.m_parent).m_world_position;
+				spatial.m_world_position = spatial.m_position + spatials.get<Position>(base.m_parent).m_world_position;
 			else
 				spatial.m_world_position = spatial.m_position;
 		}
 	}
 
+	/// Parents always come before their children, so their clip areas are already up to date
+	/// when a child is reached
+	void update_clip(size_t i)
+	{
+		auto &clip = m_spatials.at<Clip>(i);
+		auto const &base = m_spatials.at<Base>(i);
+		auto const &pos = m_spatials.at<Position>(i);
+
+		red::vector2f clip_min, clip_max;
+		if(base.m_parent.is_valid())
+		{
+			auto const &parent_clip = m_spatials.get<Clip>(base.m_parent);
+			clip_min = parent_clip.m_world_clip_position;
+			clip_max = parent_clip.m_world_clip_position + parent_clip.m_world_clip_size;
+
+			if(parent_clip.m_clips_children)
+			{
+				auto const &parent_pos = m_spatials.get<Position>(base.m_parent);
+				red::vector2f const parent_max = parent_pos.m_world_position + parent_pos.m_bounding_box;
+				clip_min = red::vector2f(std::max(clip_min.x(), parent_pos.m_world_position.x()),
+				                         std::max(clip_min.y(), parent_pos.m_world_position.y()));
+				clip_max = red::vector2f(std::min(clip_max.x(), parent_max.x()),
+				                         std::min(clip_max.y(), parent_max.y()));
+			}
+		}
+		else
+			clip_max = m_viewport;
+
+		clip.m_world_clip_position = clip_min;
+		clip.m_world_clip_size = red::vector2f(std::max(clip_max.x() - clip_min.x(), 0.0f),
+		                                       std::max(clip_max.y() - clip_min.y(), 0.0f));
+
+		red::vector2f const pos_max = pos.m_world_position + pos.m_bounding_box;
+		clip.m_visible = pos.m_world_position.x() < clip_max.x() && pos_max.x() > clip_min.x() &&
+		                 pos.m_world_position.y() < clip_max.y() && pos_max.y() > clip_min.y();
+	}
+
 	void update_z()
 	{
 		if(m_spatials.size())
 		{
 			size_t offset = 0;
-			update_z_internal(0, &offset);
+			size_t const first = first_child_index(HandleType());
+			if(first < m_spatials.size())
+				update_z_internal(first, &offset);
 		}
 	}
 
@@ -204,11 +611,16 @@ private:
 
 		while(true)
 		{
-			z_data->m_world_z_index = *offset + z_data->m_z_offset;
+			light::uint4 const world_z_index = *offset + z_data->m_z_offset;
+			if(z_data->m_world_z_index != world_z_index)
+			{
+				z_data->m_world_z_index = world_z_index;
+				m_changed.set(m_spatials.get_index(current));
+			}
 			*offset += z_data->m_z_offset + z_data->m_depth;
 
 			if(has_children(current))
-				update_z_internal(m_spatials.get_index(current) + 1, offset);
+				update_z_internal(first_child_index(current), offset);
 
 			current = base->m_successor;
 			if(current.is_valid())
@@ -223,6 +635,95 @@ private:
 };
 
 
+/// Joins a catalog whose elements refer to spatials with the spatial catalog. The index of
+/// each element's spatial is cached and only resolved again when the layout of either catalog
+/// changes, so passes over the catalog don't need a handle lookup per element. Once the
+/// catalog is in spatial order, the cached indices are increasing and a pass walks the
+/// spatial catalog sequentially.
+template<typename TCatalog, typename TValue>
+class SpatialJoin
+{
+public:
+	typedef SpatialCatalog::HandleType TValue::*MemberType;
+
+	/// member is the element's handle to its spatial
+	SpatialJoin(SpatialCatalog const &spatials, TCatalog const &catalog, MemberType member) :
+		m_spatials(spatials),
+		m_catalog(catalog),
+		m_member(member),
+		m_spatial_version(size_t(-1)),
+		m_layout_version(size_t(-1)) {}
+
+	/// Returns the spatial index of each element. The spatials of all elements have to exist,
+	/// since large catalogs are resolved on the threads of the shared pool.
+	std::vector<size_t> const& indices()
+	{
+		if(m_spatial_version != m_spatials.version() || m_layout_version != m_catalog.layout_version())
+		{
+			m_indices.resize(m_catalog.size());
+			parallel_for_each<TValue>(m_catalog, ResolveIndex(m_spatials, m_member, m_indices.data()));
+
+			m_spatial_version = m_spatials.version();
+			m_layout_version = m_catalog.layout_version();
+		}
+
+		return m_indices;
+	}
+
+	/// Returns the permutation that puts the elements in the order of their spatials, which
+	/// can be passed to CatalogSet::apply_permutation()
+	std::vector<size_t> spatial_order()
+	{
+		std::vector<size_t> const &spatial_indices = indices();
+
+		std::vector<size_t> perm(spatial_indices.size());
+		for(size_t i = 0; i < perm.size(); ++i)
+			perm[i] = i;
+		std::stable_sort(perm.begin(), perm.end(), ByIndex(spatial_indices));
+
+		return perm;
+	}
+
+private:
+	SpatialCatalog const &m_spatials;
+	TCatalog const &m_catalog;
+	MemberType m_member;
+
+	std::vector<size_t> m_indices;
+	size_t m_spatial_version;
+	size_t m_layout_version;
+
+	/// Stores the index of an element's spatial. Handle lookups only read the spatial catalog,
+	/// so elements can be resolved concurrently.
+	struct ResolveIndex
+	{
+		ResolveIndex(SpatialCatalog const &spatials, MemberType member, size_t *indices) :
+			m_spatials(&spatials),
+			m_member(member),
+			m_indices(indices) {}
+
+		void operator () (size_t index, TValue const &value) const
+		{
+			m_indices[index] = m_spatials->get_index(value.*m_member);
+		}
+
+		SpatialCatalog const *m_spatials;
+		MemberType m_member;
+		size_t *m_indices;
+	};
+
+	struct ByIndex
+	{
+		explicit ByIndex(std::vector<size_t> const &indices) :
+			m_indices(&indices) {}
+
+		bool operator () (size_t lhs, size_t rhs) const { return (*m_indices)[lhs] < (*m_indices)[rhs]; }
+
+		std::vector<size_t> const *m_indices;
+	};
+};
+
+
 class SpatialHandle
 {
 public:
@@ -244,6 +745,10 @@ public:
 	{
 		return m_catalog.get<SpatialCatalog::Position>(m_handle).m_bounding_box;
 	}
+	bool& clips_children()
+	{
+		return m_catalog.get<SpatialCatalog::Clip>(m_handle).m_clips_children;
+	}
 
 private:
 	HandleType m_handle;
@@ -254,54 +759,179 @@ private:
 //=================================================================================================
 //
 //=================================================================================================
+/// The appearance of a rectangle
+struct RectStyle
+{
+	RectStyle(sf::Color fill = sf::Color::Red, sf::Color border = sf::Color::White,
+	          float border_thickness = 5, float corner_radius = 0) :
+		m_fill(fill),
+		m_border(border),
+		m_border_thickness(border_thickness),
+		m_corner_radius(corner_radius) {}
+
+	sf::Color m_fill;
+	sf::Color m_border;
+	float m_border_thickness;
+	float m_corner_radius;
+};
+
+
 class RectangleRenderer
 {
 public:
-	RectangleRenderer(sf::RenderWindow &win) :
-		m_window(win) {}
+	typedef graf::rect_renderer::rect_id RectId;
+
+	/// Marks entities that currently have no rect in the renderer
+	static RectId const NoRect = RectId(-1);
+
+	RectangleRenderer(graf::rect_renderer &renderer) :
+		m_renderer(renderer) {}
+
+	RectId add(red::vector2f pos, red::vector2f dim, light::uint4 z_index, RectStyle const &style, graf::clip_rect const &clip)
+	{
+		return m_renderer.add(make_rect(pos, dim, z_index, style, clip));
+	}
 
-	void add(red::vector2f pos, red::vector2f dim, light::uint4 z_index, sf::Color color = sf::Color::Red)
+	/// Only rects that have actually changed are uploaded again
+	void change(RectId rect, red::vector2f pos, red::vector2f dim, light::uint4 z_index, RectStyle const &style, graf::clip_rect const &clip)
 	{
-		sf::RectangleShape rectangle;
-		rectangle.setSize(sf::Vector2f(dim.x(), dim.y()));
-		rectangle.setFillColor(color);
-		rectangle.setOutlineThickness(5);
-		rectangle.setPosition(pos.x(), pos.y());
+		m_renderer.change(rect, make_rect(pos, dim, z_index, style, clip));
+	}
+
+	/// Adds a rect showing an area of the image texture, multiplied by tint
+	RectId add_image(red::vector2f pos, red::vector2f dim, light::uint4 z_index, graf::texture_atlas::region const &region, sf::Color tint, graf::clip_rect const &clip)
+	{
+		return m_renderer.add(make_image(pos, dim, z_index, region, tint, clip));
+	}
 
-		m_rects.push_back(entry(rectangle, z_index));
+	void change_image(RectId rect, red::vector2f pos, red::vector2f dim, light::uint4 z_index, graf::texture_atlas::region const &region, sf::Color tint, graf::clip_rect const &clip)
+	{
+		m_renderer.change(rect, make_image(pos, dim, z_index, region, tint, clip));
 	}
 
-	void display()
+	void remove(RectId rect)
 	{
-		std::sort(m_rects.begin(), m_rects.end());
+		m_renderer.remove(rect);
+	}
 
-		for(auto &shape: m_rects)
-			m_window.draw(shape.m_shape);
+	void display(light::uint4 width, light::uint4 height)
+	{
+		m_renderer.display(width, height);
 	}
 
-	void clear()
+	/// Converts a clip area to whole pixels, rounding outwards
+	static graf::clip_rect clip_rect(SpatialCatalog::Clip const &clip)
 	{
-		m_rects.clear();
+		float const left = std::floor(clip.m_world_clip_position.x());
+		float const top = std::floor(clip.m_world_clip_position.y());
+		float const right = std::ceil(clip.m_world_clip_position.x() + clip.m_world_clip_size.x());
+		float const bottom = std::ceil(clip.m_world_clip_position.y() + clip.m_world_clip_size.y());
+
+		graf::clip_rect result =
+		{
+			{GLushort(left), GLushort(top)},
+			{GLushort(right - left), GLushort(bottom - top)}
+		};
+
+		return result;
 	}
 
 private:
-	struct entry
+	graf::rect_renderer &m_renderer;
+
+	static graf::rect_instance make_rect(red::vector2f pos, red::vector2f dim, light::uint4 z_index, RectStyle const &style, graf::clip_rect const &clip)
+	{
+		graf::rect_instance rect =
+		{
+			{pos.x(), pos.y()},
+			{dim.x(), dim.y()},
+			{style.m_fill.r, style.m_fill.g, style.m_fill.b, style.m_fill.a},
+			{style.m_border.r, style.m_border.g, style.m_border.b, style.m_border.a},
+			style.m_border_thickness,
+			style.m_corner_radius,
+			z_index
+		};
+		rect.clip = clip;
+
+		return rect;
+	}
+
+	static graf::rect_instance make_image(red::vector2f pos, red::vector2f dim, light::uint4 z_index, graf::texture_atlas::region const &region, sf::Color tint, graf::clip_rect const &clip)
+	{
+		graf::rect_instance rect = make_rect(pos, dim, z_index, RectStyle(tint, sf::Color::Transparent, 0), clip);
+		rect.texture_position[0] = region.position[0];
+		rect.texture_position[1] = region.position[1];
+		rect.texture_size[0] = region.size[0];
+		rect.texture_size[1] = region.size[1];
+		rect.kind = graf::rect_image;
+
+		return rect;
+	}
+};
+
+
+
+/// Makes SFML's font rendering available to graf
+///
+/// Every SFML call that touches a texture (and the creation of SFML's shared context) binds
+/// SFML's own context and afterwards releases it with glXMakeCurrent(None). That would leave the
+/// thread without graf's context, so we make it current again after each of them.
+class SfmlFont : public graf::font
+{
+public:
+	SfmlFont(graf::opengl_device &opengl, char const *path) :
+		m_opengl(opengl),
+		m_font(new sf::Font)
+	{
+		bool loaded = m_font->loadFromFile(path);
+		m_opengl.make_current();
+		if(!loaded)
+			throw light::runtime_error("Cannot load font");
+	}
+
+	~SfmlFont()
 	{
-		entry(sf::RectangleShape const &shape, size_t z_index) :
-			m_shape(shape),
-			m_z_index(z_index) {}
+		// Destroying the font releases its glyph textures through SFML's context
+		m_font.reset();
+		m_opengl.make_current();
+	}
 
-		bool operator < (entry const &rhs) const
+	void rasterize(light::uint4 code_point, light::uint4 pixel_size, graf::glyph_bitmap &glyph)
+	{
+		sf::Glyph const &sf_glyph = m_font->getGlyph(code_point, pixel_size, false);
+		sf::IntRect const &area = sf_glyph.textureRect;
+		sf::Image image = m_font->getTexture(pixel_size).copyToImage();
+		m_opengl.make_current();
+
+		glyph.width = area.width;
+		glyph.height = area.height;
+		glyph.left = int(sf_glyph.bounds.left);
+		glyph.top = int(sf_glyph.bounds.top);
+		glyph.advance = sf_glyph.advance;
+
+		// SFML stores the coverage in the alpha channel
+		glyph.coverage.resize(glyph.width * glyph.height);
+		for(int y = 0; y < area.height; ++y)
 		{
-			return m_z_index < rhs.m_z_index;
+			for(int x = 0; x < area.width; ++x)
+				glyph.coverage[y * area.width + x] = image.getPixel(area.left + x, area.top + y).a;
 		}
+	}
 
-		sf::RectangleShape m_shape;
-		size_t m_z_index;
-	};
+	/// sf::Text puts the first baseline at the character size, so we do the same
+	float ascent(light::uint4 pixel_size)
+	{
+		return float(pixel_size);
+	}
 
-	sf::RenderWindow &m_window;
-	std::vector<entry> m_rects;
+	float line_height(light::uint4 pixel_size)
+	{
+		return float(m_font->getLineSpacing(pixel_size));
+	}
+
+private:
+	graf::opengl_device &m_opengl;
+	std::unique_ptr<sf::Font> m_font;
 };
 
 
@@ -360,6 +990,33 @@ public:
 		m_events.insert(m_events.begin() + pos, e);
 	}
 
+	/// Reorders the events like the spatials, see SpatialCatalog::commit_batch()
+	void apply_permutation(std::vector<size_t> const &perm)
+	{
+		assert(perm.size() == m_events.size());
+
+		std::vector<Event> events(perm.size());
+		for(size_t i = 0; i < perm.size(); i++)
+			events[i] = m_events[perm[i]];
+		m_events.swap(events);
+	}
+
+	/// Removes the events of dead spatials. Has to be called right before the spatials are
+	/// compacted.
+	void compact()
+	{
+		if(m_focused.is_valid() && m_spatials.is_dead(m_spatials.get_index(m_focused)))
+			m_focused = SpatialCatalog::HandleType();
+
+		size_t out = 0;
+		for(size_t i = 0; i < m_events.size(); i++)
+		{
+			if(!m_spatials.is_dead(i))
+				m_events[out++] = m_events[i];
+		}
+		m_events.erase(m_events.begin() + out, m_events.end());
+	}
+
 	Event& get(SpatialCatalog::HandleType h)
 	{
 		auto index = m_spatials.get_index(h);
@@ -368,12 +1025,11 @@ public:
 		return m_events[index];
 	}
 
+	/// Clears the events of the last frame. Large catalogs are cleared in parallel.
 	void update()
 	{
-		for(size_t i = 0; i < m_events.size(); i++)
-		{
-			m_events[i].m_events = 0;
-		}
+		ClearEvents clear(m_events.data());
+		parallel_for(ThreadPool::shared(), m_events.size(), elements_per_line<Event>(), clear);
 	}
 
 	void mouse_button_press(MouseButton but, red::vector2f pos)
@@ -413,12 +1069,17 @@ public:
 	SpatialCatalog::HandleType get_element_by_pos(red::vector2f pos)
 	{
 		SpatialCatalog::HandleType element;
+		auto view = m_spatials.view<SpatialCatalog::Position, SpatialCatalog::ZData, SpatialCatalog::Clip>(0, m_events.size());
 
 		size_t cur_z = 0;
-		for(size_t i = 0; i < m_events.size(); i++)
+		for(size_t i = 0; i < view.size(); i++)
 		{
-			auto spatial = m_spatials.at<SpatialCatalog::Position>(i);
-			auto z_data = m_spatials.at<SpatialCatalog::ZData>(i);
+			auto const &spatial = view.get<SpatialCatalog::Position const>(i);
+			auto const &z_data = view.get<SpatialCatalog::ZData const>(i);
+
+			// Culled elements, e.g. unused rows of a scroll view, cannot be hit
+			if(!view.get<SpatialCatalog::Clip const>(i).m_visible)
+				continue;
 
 			if(z_data.m_world_z_index > cur_z)
 			{
@@ -431,6 +1092,20 @@ public:
 	}
 
 private:
+	struct ClearEvents
+	{
+		explicit ClearEvents(Event *events) :
+			m_events(events) {}
+
+		void operator () (size_t begin, size_t end) const
+		{
+			for(size_t i = begin; i < end; i++)
+				m_events[i].m_events = 0;
+		}
+
+		Event *m_events;
+	};
+
 	std::vector<Event> m_events;
 	SpatialCatalog &m_spatials;
 	SpatialCatalog::HandleType m_focused;
@@ -467,33 +1142,94 @@ public:
 
 	struct Entity
 	{
-		Entity(SpatialCatalog::HandleType spatial, sf::Color color) :
+		Entity(SpatialCatalog::HandleType spatial, RectStyle const &style) :
 			m_spatial(spatial),
-			m_color(color) {}
+			m_style(style),
+			m_rect(RectangleRenderer::NoRect) {}
 
 		SpatialCatalog::HandleType m_spatial;
-		sf::Color m_color;
+		RectStyle m_style;
+		/// The entity's slot in the renderer, NoRect while it is culled
+		RectangleRenderer::RectId m_rect;
 	};
 
 	typedef CatalogSet<HandleType, Entity> CatalogType;
 
 	DisplayCatalog(SpatialCatalog const &spatials, RectangleRenderer &renderer) :
 		m_spatials(spatials),
-		m_renderer(renderer) {}
+		m_renderer(renderer),
+		m_join(spatials, m_entities, &Entity::m_spatial)
+	{
+		m_entities.track_changes<Entity>();
+	}
 
+	/// The entity gets its rect in the renderer when it is first rendered
 	HandleType add(Entity const &entity)
 	{
 		return m_entities.add(entity);
 	}
 
+	/// Passes the current state of all visible entities to the renderer, which only uploads the
+	/// entities that have changed since the last frame. Entities that are outside of the
+	/// viewport or clipped away by their ancestors are removed from the renderer, so they cost
+	/// nothing to draw.
+	///
+	/// Entities are skipped if neither they nor their spatial have changed since the last
+	/// render, so entities must only be modified through get().
 	void render()
 	{
-		for(auto ent = m_entities.begin<Entity>(); ent != m_entities.end<Entity>(); ++ent)
+		CatalogType const &entities = m_entities;
+		std::vector<size_t> const &spatial_indices = m_join.indices();
+		for(size_t i = 0; i < entities.size(); ++i)
 		{
-			SpatialCatalog::Position const &pos = m_spatials.get<SpatialCatalog::Position>(ent->m_spatial);
-			SpatialCatalog::ZData const &z_data = m_spatials.get<SpatialCatalog::ZData>(ent->m_spatial);
-			m_renderer.add(pos.m_world_position, pos.m_bounding_box, z_data.m_world_z_index, ent->m_color);
+			Entity const &ent = entities.at<Entity>(i);
+			size_t const spatial_index = spatial_indices[i];
+			if(!entities.is_dirty<Entity>(i) && !m_spatials.changed(spatial_index))
+				continue;
+
+			SpatialCatalog::Clip const &clip = m_spatials.at<SpatialCatalog::Clip>(spatial_index);
+			if(!clip.m_visible)
+			{
+				if(ent.m_rect != RectangleRenderer::NoRect)
+				{
+					m_renderer.remove(ent.m_rect);
+					m_entities.at<Entity>(i).m_rect = RectangleRenderer::NoRect;
+				}
+				continue;
+			}
+
+			SpatialCatalog::Position const &pos = m_spatials.at<SpatialCatalog::Position>(spatial_index);
+			SpatialCatalog::ZData const &z_data = m_spatials.at<SpatialCatalog::ZData>(spatial_index);
+			if(ent.m_rect == RectangleRenderer::NoRect)
+				m_entities.at<Entity>(i).m_rect = m_renderer.add(pos.m_world_position, pos.m_bounding_box, z_data.m_world_z_index, ent.m_style, RectangleRenderer::clip_rect(clip));
+			else
+				m_renderer.change(ent.m_rect, pos.m_world_position, pos.m_bounding_box, z_data.m_world_z_index, ent.m_style, RectangleRenderer::clip_rect(clip));
+		}
+
+		m_entities.clear_dirty<Entity>();
+	}
+
+	/// Puts the entities in the order of their spatials
+	void sort_by_spatial()
+	{
+		m_entities.apply_permutation(m_join.spatial_order());
+	}
+
+	/// Removes all entities whose spatial has been removed
+	void remove_detached()
+	{
+		for(size_t i = 0; i < m_entities.size(); ++i)
+		{
+			Entity &ent = m_entities.at<Entity>(i);
+			if(!m_spatials.contains(ent.m_spatial))
+			{
+				if(ent.m_rect != RectangleRenderer::NoRect)
+					m_renderer.remove(ent.m_rect);
+				m_entities.mark_dead(m_entities.get_handle(i));
+			}
 		}
+
+		m_entities.compact();
 	}
 
 	Entity& get(HandleType h)
@@ -510,6 +1246,7 @@ private:
 	CatalogType m_entities;
 	SpatialCatalog const &m_spatials;
 	RectangleRenderer &m_renderer;
+	SpatialJoin<CatalogType, Entity> m_join;
 };
 
 class DisplayHandle
@@ -525,7 +1262,10 @@ public:
 	DisplayCatalog::HandleType display() { return m_display; }
 	SpatialHandle spatial() { return m_spatial; }
 
-	sf::Color& color() { return m_catalog.get(display()).m_color; }
+	sf::Color& color() { return m_catalog.get(display()).m_style.m_fill; }
+	sf::Color& border_color() { return m_catalog.get(display()).m_style.m_border; }
+	float& border_thickness() { return m_catalog.get(display()).m_style.m_border_thickness; }
+	float& corner_radius() { return m_catalog.get(display()).m_style.m_corner_radius; }
 
 private:
 	SpatialHandle m_spatial;
@@ -534,6 +1274,289 @@ private:
 };
 
 
+//=================================================================================================
+//
+//=================================================================================================
+class TextCatalog
+{
+private:
+	class UniqueType {};
+
+public:
+	typedef Handle<UniqueType> HandleType;
+
+	struct Label
+	{
+		Label(SpatialCatalog::HandleType spatial, graf::text_renderer::text_id text, sf::Color color) :
+			m_spatial(spatial),
+			m_text(text),
+			m_color(color) {}
+
+		SpatialCatalog::HandleType m_spatial;
+		graf::text_renderer::text_id m_text;
+		sf::Color m_color;
+	};
+
+	typedef CatalogSet<HandleType, Label> CatalogType;
+
+	TextCatalog(SpatialCatalog const &spatials, graf::text_renderer &renderer) :
+		m_spatials(spatials),
+		m_renderer(renderer),
+		m_join(spatials, m_labels, &Label::m_spatial)
+	{
+		m_labels.track_changes<Label>();
+	}
+
+	HandleType add(SpatialCatalog::HandleType spatial, char const *text, graf::glyph_atlas::font_id font, float size, sf::Color color)
+	{
+		SpatialCatalog::Position const &pos = m_spatials.get<SpatialCatalog::Position>(spatial);
+		SpatialCatalog::ZData const &z_data = m_spatials.get<SpatialCatalog::ZData>(spatial);
+
+		auto text_id = m_renderer.add(text, font, size, pos.m_world_position.x(), pos.m_world_position.y(),
+		                              to_color(color), z_data.m_world_z_index);
+
+		return m_labels.add(Label(spatial, text_id, color));
+	}
+
+	/// Moves the glyphs of all labels to their spatials. Like rects, glyphs are only uploaded
+	/// if they have changed, and culled labels are hidden. Labels whose spatial has not changed
+	/// since the last render are skipped.
+	void render()
+	{
+		CatalogType const &labels = m_labels;
+		std::vector<size_t> const &spatial_indices = m_join.indices();
+		for(size_t i = 0; i < labels.size(); ++i)
+		{
+			Label const &label = labels.at<Label>(i);
+			size_t const spatial_index = spatial_indices[i];
+			if(!labels.is_dirty<Label>(i) && !m_spatials.changed(spatial_index))
+				continue;
+
+			SpatialCatalog::Clip const &clip = m_spatials.at<SpatialCatalog::Clip>(spatial_index);
+			m_renderer.visible(label.m_text, clip.m_visible);
+			if(!clip.m_visible)
+				continue;
+
+			SpatialCatalog::Position const &pos = m_spatials.at<SpatialCatalog::Position>(spatial_index);
+			SpatialCatalog::ZData const &z_data = m_spatials.at<SpatialCatalog::ZData>(spatial_index);
+			m_renderer.change(label.m_text, pos.m_world_position.x(), pos.m_world_position.y(),
+			                  to_color(label.m_color), z_data.m_world_z_index, RectangleRenderer::clip_rect(clip));
+		}
+
+		m_labels.clear_dirty<Label>();
+	}
+
+	/// Replaces the text of a label
+	void text(HandleType h, char const *text)
+	{
+		m_renderer.change_text(m_labels.get<Label>(h).m_text, text);
+	}
+
+	/// Returns the size of a label's text
+	red::vector2f size(HandleType h) const
+	{
+		auto text = m_labels.get<Label>(h).m_text;
+		return red::vector2f(m_renderer.width(text), m_renderer.height(text));
+	}
+
+	/// Puts the labels in the order of their spatials
+	void sort_by_spatial()
+	{
+		m_labels.apply_permutation(m_join.spatial_order());
+	}
+
+	/// Removes all labels whose spatial has been removed
+	void remove_detached()
+	{
+		for(size_t i = 0; i < m_labels.size(); ++i)
+		{
+			Label const &label = m_labels.at<Label>(i);
+			if(!m_spatials.contains(label.m_spatial))
+			{
+				m_renderer.remove(label.m_text);
+				m_labels.mark_dead(m_labels.get_handle(i));
+			}
+		}
+
+		m_labels.compact();
+	}
+
+	Label& get(HandleType h)
+	{
+		return m_labels.get<Label>(h);
+	}
+
+private:
+	CatalogType m_labels;
+	SpatialCatalog const &m_spatials;
+	graf::text_renderer &m_renderer;
+	SpatialJoin<CatalogType, Label> m_join;
+
+	static graf::color to_color(sf::Color c)
+	{
+		graf::color result = {c.r, c.g, c.b, c.a};
+		return result;
+	}
+};
+
+class LabelHandle
+{
+public:
+	LabelHandle(SpatialHandle spatial, TextCatalog::HandleType label, TextCatalog &catalog) :
+		m_spatial(spatial),
+		m_label(label),
+		m_catalog(catalog) {}
+
+	TextCatalog::HandleType label() { return m_label; }
+	SpatialHandle spatial() { return m_spatial; }
+
+	/// Replaces the text and resizes the label's bounding box to fit it
+	void text(char const *text)
+	{
+		m_catalog.text(m_label, text);
+		m_spatial.bounding_box() = m_catalog.size(m_label);
+	}
+	sf::Color& color() { return m_catalog.get(m_label).m_color; }
+
+private:
+	SpatialHandle m_spatial;
+	TextCatalog::HandleType m_label;
+	TextCatalog &m_catalog;
+};
+
+
+//=================================================================================================
+//
+//=================================================================================================
+class ImageCatalog
+{
+private:
+	class UniqueType {};
+
+public:
+	typedef Handle<UniqueType> HandleType;
+
+	struct Image
+	{
+		Image(SpatialCatalog::HandleType spatial, graf::texture_atlas::image_id image, sf::Color tint) :
+			m_spatial(spatial),
+			m_image(image),
+			m_tint(tint),
+			m_rect(RectangleRenderer::NoRect) {}
+
+		SpatialCatalog::HandleType m_spatial;
+		graf::texture_atlas::image_id m_image;
+		sf::Color m_tint;
+		RectangleRenderer::RectId m_rect;
+	};
+
+	typedef CatalogSet<HandleType, Image> CatalogType;
+
+	ImageCatalog(SpatialCatalog const &spatials, RectangleRenderer &renderer, graf::texture_atlas &atlas) :
+		m_spatials(spatials),
+		m_renderer(renderer),
+		m_atlas(atlas),
+		m_join(spatials, m_images, &Image::m_spatial) {}
+
+	/// The image gets its rect in the renderer when it is first rendered
+	HandleType add(Image const &image)
+	{
+		return m_images.add(image);
+	}
+
+	/// Uses every visible image, so it stays in the atlas (or is put back if it has been
+	/// evicted), and uploads the images that had to be placed in one go. Culled images are
+	/// removed from the renderer and may be evicted.
+	void render()
+	{
+		m_atlas.next_frame();
+
+		std::vector<size_t> const &spatial_indices = m_join.indices();
+		for(size_t i = 0; i < m_images.size(); ++i)
+		{
+			Image *img = &m_images.at<Image>(i);
+			size_t const spatial_index = spatial_indices[i];
+
+			SpatialCatalog::Clip const &clip = m_spatials.at<SpatialCatalog::Clip>(spatial_index);
+			if(!clip.m_visible)
+			{
+				if(img->m_rect != RectangleRenderer::NoRect)
+				{
+					m_renderer.remove(img->m_rect);
+					img->m_rect = RectangleRenderer::NoRect;
+				}
+				continue;
+			}
+
+			SpatialCatalog::Position const &pos = m_spatials.at<SpatialCatalog::Position>(spatial_index);
+			SpatialCatalog::ZData const &z_data = m_spatials.at<SpatialCatalog::ZData>(spatial_index);
+			if(img->m_rect == RectangleRenderer::NoRect)
+				img->m_rect = m_renderer.add_image(pos.m_world_position, pos.m_bounding_box, z_data.m_world_z_index,
+				                                   m_atlas.use(img->m_image), img->m_tint, RectangleRenderer::clip_rect(clip));
+			else
+				m_renderer.change_image(img->m_rect, pos.m_world_position, pos.m_bounding_box, z_data.m_world_z_index,
+				                        m_atlas.use(img->m_image), img->m_tint, RectangleRenderer::clip_rect(clip));
+		}
+
+		m_atlas.flush();
+	}
+
+	/// Puts the images in the order of their spatials
+	void sort_by_spatial()
+	{
+		m_images.apply_permutation(m_join.spatial_order());
+	}
+
+	/// Removes all images whose spatial has been removed. The images stay in the atlas.
+	void remove_detached()
+	{
+		for(size_t i = 0; i < m_images.size(); ++i)
+		{
+			Image const &img = m_images.at<Image>(i);
+			if(!m_spatials.contains(img.m_spatial))
+			{
+				if(img.m_rect != RectangleRenderer::NoRect)
+					m_renderer.remove(img.m_rect);
+				m_images.mark_dead(m_images.get_handle(i));
+			}
+		}
+
+		m_images.compact();
+	}
+
+	Image& get(HandleType h)
+	{
+		return m_images.get<Image>(h);
+	}
+
+private:
+	CatalogType m_images;
+	SpatialCatalog const &m_spatials;
+	RectangleRenderer &m_renderer;
+	graf::texture_atlas &m_atlas;
+	SpatialJoin<CatalogType, Image> m_join;
+};
+
+class ImageHandle
+{
+public:
+	ImageHandle(SpatialHandle spatial, ImageCatalog::HandleType image, ImageCatalog &catalog) :
+		m_spatial(spatial),
+		m_image(image),
+		m_catalog(catalog) {}
+
+	ImageCatalog::HandleType image() { return m_image; }
+	SpatialHandle spatial() { return m_spatial; }
+
+	sf::Color& tint() { return m_catalog.get(m_image).m_tint; }
+
+private:
+	SpatialHandle m_spatial;
+	ImageCatalog::HandleType m_image;
+	ImageCatalog &m_catalog;
+};
+
+
 //=================================================================================================
 //
 //=================================================================================================
@@ -587,6 +1610,18 @@ public:
 
 	}
 
+	/// Removes all buttons whose spatial has been removed
+	void remove_detached()
+	{
+		for(size_t i = 0; i < m_buttons.size(); ++i)
+		{
+			if(!m_spatials.contains(m_buttons.at<Button>(i).m_position))
+				m_buttons.mark_dead(m_buttons.get_handle(i));
+		}
+
+		m_buttons.compact();
+	}
+
 	Button& get(HandleType h)
 	{
 		return m_buttons.get<Button>(h);
@@ -630,47 +1665,336 @@ private:
 };
 
 
+//=================================================================================================
+//
+//=================================================================================================
+/// Supplies the rows of a ScrollView
+class RowSource
+{
+public:
+	virtual ~RowSource() {}
+
+	/// Returns the number of rows in the data set
+	virtual size_t num_rows() const = 0;
+
+	/// Creates the widgets of a pooled row as children of the given spatial. Slots are numbered
+	/// from 0 in the order they are created.
+	virtual void create_row(size_t slot, SpatialCatalog::HandleType row) = 0;
+
+	/// Shows the data row with the given index in the given pooled row
+	virtual void bind_row(size_t slot, size_t index) = 0;
+};
+
+/// A vertical list of rows with a fixed height that only materializes the rows intersecting its
+/// bounding box. Rows are pooled: a data row is always shown in slot index % pool size, so when
+/// scrolling only the rows that have just become visible are bound again. The pool only grows
+/// if the view gets higher, so memory and update cost depend on the view's size, not on the
+/// number of rows.
+class ScrollView
+{
+public:
+	ScrollView(SpatialCatalog &spatials, InputCatalog &input, SpatialCatalog::HandleType parent,
+	           red::vector2f pos, red::vector2f dim, float row_height, RowSource &source) :
+		m_spatials(spatials),
+		m_input(input),
+		m_container(spatials.add(parent, pos, dim)),
+		m_source(source),
+		m_row_height(row_height),
+		m_offset(0)
+	{
+		m_input.add(m_spatials.get_index(m_container), InputCatalog::Event());
+		m_spatials.get<SpatialCatalog::Clip>(m_container).m_clips_children = true;
+	}
+
+	SpatialHandle spatial() { return SpatialHandle(m_container, m_spatials); }
+
+	/// Returns the spatial that contains the rows
+	SpatialCatalog::HandleType container() const { return m_container; }
+
+	/// Returns the scroll offset in pixels
+	float offset() const { return m_offset; }
+
+	/// Scrolls to the given offset in pixels. It is clamped to the scrollable range in update().
+	void scroll_to(float offset) { m_offset = offset; }
+	void scroll_by(float delta) { m_offset += delta; }
+
+	/// Returns the index of the first visible data row
+	size_t first_row() const { return size_t(m_offset / m_row_height); }
+
+	/// Positions the pooled rows for the current scroll offset and binds the rows that have
+	/// become visible. Has to be called before the spatials are updated.
+	void update()
+	{
+		SpatialCatalog const &spatials = m_spatials;
+		red::vector2f const dim = spatials.get<SpatialCatalog::Position>(m_container).m_bounding_box;
+		size_t const num_rows = m_source.num_rows();
+
+		float const max_offset = std::max(num_rows * m_row_height - dim.y(), 0.0f);
+		m_offset = std::min(std::max(m_offset, 0.0f), max_offset);
+
+		// One more row than fits, since the first and the last row are usually cut off
+		size_t const pool_size = size_t(std::ceil(dim.y() / m_row_height)) + 1;
+		while(m_rows.size() < pool_size)
+		{
+			size_t const slot = m_rows.size();
+			m_rows.push_back(m_spatials.add(m_container, red::vector2f(), red::vector2f(dim.x(), m_row_height)));
+			m_input.add(m_spatials.get_index(m_rows.back()), InputCatalog::Event());
+			m_bound.push_back(size_t(NotBound)); // A copy, so NotBound needs no definition
+			m_source.create_row(slot, m_rows.back());
+		}
+
+		size_t const first = first_row();
+		for(size_t index = first; index < first + m_rows.size(); ++index)
+		{
+			size_t const slot = index % m_rows.size();
+
+			if(index < num_rows)
+			{
+				place_row(slot, red::vector2f(0.0f, index * m_row_height - m_offset), dim.x());
+				if(m_bound[slot] != index)
+				{
+					m_source.bind_row(slot, index);
+					m_bound[slot] = index;
+				}
+			}
+			else
+			{
+				// There is no data for this slot, so it is moved below the view and culled
+				place_row(slot, red::vector2f(0.0f, dim.y()), dim.x());
+			}
+		}
+	}
+
+private:
+	static size_t const NotBound = size_t(-1);
+
+	/// Moves a pooled row. Rows which stay where they are are not written, so they are not
+	/// updated again by the spatial catalog.
+	void place_row(size_t slot, red::vector2f position, float width)
+	{
+		SpatialCatalog const &spatials = m_spatials;
+		auto const &pos = spatials.get<SpatialCatalog::Position>(m_rows[slot]);
+
+		if(pos.m_position.x() != position.x() || pos.m_position.y() != position.y() ||
+		   pos.m_bounding_box.x() != width || pos.m_bounding_box.y() != m_row_height)
+		{
+			auto &changed = m_spatials.get<SpatialCatalog::Position>(m_rows[slot]);
+			changed.m_position = position;
+			changed.m_bounding_box = red::vector2f(width, m_row_height);
+		}
+	}
+
+	SpatialCatalog &m_spatials;
+	InputCatalog &m_input;
+	SpatialCatalog::HandleType m_container;
+	RowSource &m_source;
+	float m_row_height;
+	float m_offset;
+
+	/// The pooled rows and the data row each of them shows
+	std::vector<SpatialCatalog::HandleType> m_rows;
+	std::vector<size_t> m_bound;
+};
+
+
+/// Owns the scroll views of a GUI. A scroll view is destroyed together with its container, so
+/// it never updates rows whose spatials are gone.
+class ScrollViewCatalog
+{
+public:
+	ScrollViewCatalog(SpatialCatalog &spatials, InputCatalog &input) :
+		m_spatials(spatials),
+		m_input(input) {}
+
+	ScrollView& add(red::vector2f pos, red::vector2f dim, float row_height, RowSource &source, SpatialCatalog::HandleType parent)
+	{
+		m_views.push_back(std::unique_ptr<ScrollView>(new ScrollView(m_spatials, m_input, parent, pos, dim, row_height, source)));
+
+		return *m_views.back();
+	}
+
+	/// Destroys all scroll views whose container has been removed. Has to be called after the
+	/// spatials have been compacted.
+	void remove_detached()
+	{
+		size_t out = 0;
+		for(size_t i = 0; i < m_views.size(); ++i)
+		{
+			if(m_spatials.contains(m_views[i]->container()))
+				m_views[out++] = std::move(m_views[i]);
+		}
+		m_views.erase(m_views.begin() + out, m_views.end());
+	}
+
+	/// Updates all scroll views, see ScrollView::update()
+	void update()
+	{
+		for(auto &view: m_views)
+			view->update();
+	}
+
+	size_t size() const { return m_views.size(); }
+
+private:
+	SpatialCatalog &m_spatials;
+	InputCatalog &m_input;
+	std::vector<std::unique_ptr<ScrollView>> m_views;
+};
+
+
 //=================================================================================================
 //
 //=================================================================================================
 class GuiMananger
 {
 public:
-	GuiMananger(RectangleRenderer &renderer) :
-		m_spatial_data(),
+	GuiMananger(RectangleRenderer &renderer, graf::text_renderer &text_renderer, graf::texture_atlas &images, red::vector2f viewport) :
+		m_spatial_data(viewport),
 		m_button_data(m_spatial_data, renderer),
 		m_input(m_spatial_data),
-		m_display(m_spatial_data, renderer) {}
-
+		m_display(m_spatial_data, renderer),
+		m_text(m_spatial_data, text_renderer),
+		m_images(m_spatial_data, renderer, images),
+		m_scroll_views(m_spatial_data, m_input),
+		m_sorted_version(0),
+		m_num_animations(0) {}
+
+	/// Widgets are added in a batch that is committed by the next update() or remove(), so
+	/// adding n widgets costs O(n) no matter where in the tree they are added.
 	ButtonHandle add_button(red::vector2f pos, red::vector2f dim, sf::Color color, SpatialCatalog::HandleType parent = SpatialCatalog::HandleType())
 	{
+		m_spatial_data.begin_batch();
 		SpatialCatalog::HandleType spatial = m_spatial_data.add(parent, pos, dim);
 		ButtonCatalog::HandleType button = m_button_data.add(ButtonCatalog::Button(color,  spatial));
 		m_input.add(m_spatial_data.get_index(spatial), InputCatalog::Event());
-		DisplayCatalog::HandleType display = m_display.add(DisplayCatalog::Entity(spatial, color));
+		DisplayCatalog::HandleType display = m_display.add(DisplayCatalog::Entity(spatial, RectStyle(color)));
 
 		SpatialHandle spat_handle(spatial, m_spatial_data);
 
 		return ButtonHandle(DisplayHandle(spat_handle, display, m_display), InputHandle(spat_handle, m_input), button, m_button_data);
 	}
 
+	LabelHandle add_label(red::vector2f pos, char const *text, graf::glyph_atlas::font_id font, float size, sf::Color color, SpatialCatalog::HandleType parent = SpatialCatalog::HandleType())
+	{
+		m_spatial_data.begin_batch();
+		SpatialCatalog::HandleType spatial = m_spatial_data.add(parent, pos, red::vector2f());
+		m_input.add(m_spatial_data.get_index(spatial), InputCatalog::Event());
+		TextCatalog::HandleType label = m_text.add(spatial, text, font, size, color);
+
+		// The label's bounding box is the size of its text
+		m_spatial_data.get<SpatialCatalog::Position>(spatial).m_bounding_box = m_text.size(label);
+
+		return LabelHandle(SpatialHandle(spatial, m_spatial_data), label, m_text);
+	}
+
+	ImageHandle add_image(red::vector2f pos, red::vector2f dim, graf::texture_atlas::image_id image, SpatialCatalog::HandleType parent = SpatialCatalog::HandleType())
+	{
+		m_spatial_data.begin_batch();
+		SpatialCatalog::HandleType spatial = m_spatial_data.add(parent, pos, dim);
+		m_input.add(m_spatial_data.get_index(spatial), InputCatalog::Event());
+		ImageCatalog::HandleType handle = m_images.add(ImageCatalog::Image(spatial, image, sf::Color::White));
+
+		return ImageHandle(SpatialHandle(spatial, m_spatial_data), handle, m_images);
+	}
+
+	/// Adds a scroll view. Its rows are created by the source, usually with add_label() and
+	/// friends, as children of the spatials it is given. The scroll view is destroyed in the
+	/// update() after its container has been removed.
+	ScrollView& add_scroll_view(red::vector2f pos, red::vector2f dim, float row_height, RowSource &source, SpatialCatalog::HandleType parent = SpatialCatalog::HandleType())
+	{
+		m_spatial_data.begin_batch();
+		return m_scroll_views.add(pos, dim, row_height, source, parent);
+	}
+
+	/// Removes a widget together with all of its children. They disappear in the next
+	/// update(), handles to them become stale then.
+	void remove(SpatialCatalog::HandleType spatial)
+	{
+		commit_batch();
+		m_spatial_data.remove(spatial);
+	}
+
 	InputCatalog& input() { return m_input; }
 
+	/// Sets the size of the viewport, elements outside of it are culled
+	void viewport(red::vector2f size) { m_spatial_data.viewport(size); }
+
 	void update()
 	{
+		// Widgets added since the last update are put in place with a single pass
+		commit_batch();
+
+		// Removed widgets are destroyed here, where no catalog is being iterated, with one
+		// sweep per catalog no matter how many widgets have been removed
+		if(m_spatial_data.num_dead())
+		{
+			m_input.compact();
+			m_spatial_data.compact();
+
+			m_button_data.remove_detached();
+			m_display.remove_detached();
+			m_text.remove_detached();
+			m_images.remove_detached();
+			m_scroll_views.remove_detached();
+		}
+
+		// Rows of scroll views that have grown are added in a batch as well
+		m_spatial_data.begin_batch();
+		m_scroll_views.update();
+		commit_batch();
+
+		// Whenever spatials have been added or removed, the catalogs that are iterated each
+		// frame are put in spatial order again, so rendering reads the spatials sequentially
+		if(m_sorted_version != m_spatial_data.version())
+		{
+			m_display.sort_by_spatial();
+			m_text.sort_by_spatial();
+			m_images.sort_by_spatial();
+			m_sorted_version = m_spatial_data.version();
+		}
+
 		m_spatial_data.update();
 		m_input.update();
 		m_button_data.update();
 	}
 
+	/// Animations keep the render loop running even if nothing has been damaged, since they
+	/// change the GUI every frame. Every begin_animation() has to be matched by an
+	/// end_animation().
+	void begin_animation() { ++m_num_animations; }
+	void end_animation()
+	{
+		assert(m_num_animations > 0);
+		--m_num_animations;
+	}
+
+	/// Returns whether any animation is running
+	bool animating() const { return m_num_animations > 0; }
+
 	void render()
 	{
 		m_display.render();
+		m_text.render();
+		m_images.render();
 	}
 
 private:
+	/// Puts the spatials added since the last commit in place. The input events are stored in
+	/// spatial order, so they are reordered the same way.
+	void commit_batch()
+	{
+		std::vector<size_t> const &perm = m_spatial_data.commit_batch();
+		if(!perm.empty())
+			m_input.apply_permutation(perm);
+	}
+
 	SpatialCatalog m_spatial_data;
 	ButtonCatalog m_button_data;
 	InputCatalog m_input;
 	DisplayCatalog m_display;
+	TextCatalog m_text;
+	ImageCatalog m_images;
+	ScrollViewCatalog m_scroll_views;
+	size_t m_sorted_version;
+	size_t m_num_animations;
 };
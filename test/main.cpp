@@ -20,12 +20,19 @@
 #include "graf/window.hpp"
 #include "graf/opengl.hpp"
 #include "graf/logger.hpp"
+#include "graf/shader.hpp"
+#include "graf/rect_renderer.hpp"
+#include "graf/damage_tracker.hpp"
+#include "graf/glyph_atlas.hpp"
+#include "graf/text_renderer.hpp"
+#include "graf/texture_atlas.hpp"
 
-//#include "gui.hpp"
+#include <SFML/Graphics.hpp>
 
-#include <iostream>
+#include "gui.hpp"
 
-#include <SFML/Graphics.hpp>
+#include <iostream>
+#include <string>
 
 
 using namespace light;
@@ -52,6 +59,38 @@ namespace red
 }
 
 
+//=================================================================================================
+//
+//=================================================================================================
+/// Rows that show their own index, to try out ScrollView with a large data set
+class NumberedRows : public RowSource
+{
+public:
+	NumberedRows(GuiMananger &gui, graf::glyph_atlas::font_id font, size_t num_rows) :
+		m_gui(gui),
+		m_font(font),
+		m_num_rows(num_rows) {}
+
+	size_t num_rows() const override { return m_num_rows; }
+
+	void create_row(size_t, SpatialCatalog::HandleType row) override
+	{
+		m_labels.push_back(m_gui.add_label({5.0f, 2.0f}, "", m_font, 16.0f, sf::Color::White, row));
+	}
+
+	void bind_row(size_t slot, size_t index) override
+	{
+		m_labels[slot].text(("Row " + std::to_string(index)).c_str());
+	}
+
+private:
+	GuiMananger &m_gui;
+	graf::glyph_atlas::font_id m_font;
+	size_t m_num_rows;
+	std::vector<LabelHandle> m_labels;
+};
+
+
 //=================================================================================================
 //
 //=================================================================================================
@@ -67,75 +106,121 @@ int main()
 
 	try
 	{
-		window render_win("ÖpänJüÄl", 800, 600, 24, 8);
+		uint width = 800, height = 600;
+
+		window render_win("ÖpänJüÄl", width, height, 24, 8);
 		opengl_device opengl(&render_win);
 
 		std::cout << str_printf("width: {}\nheight: {}", render_win.screen_width(), render_win.screen_height()) << std::endl;
 
-		glClearColor(0.5, 0, 0, 1);
-		while(render_win.process_events())
-		{
-			glClear(GL_COLOR_BUFFER_BIT);
-
-			render_win.swap_buffers();
-		}
-	}
-	catch(::std::exception const &e)
-	{
-		GRAF_ERROR_MSG("Unhandled exception: {}\n", e.what());
-	}
+		shader_manager shaders(opengl);
+		rect_renderer rects(shaders);
+		shaders.submit();
 
+		damage_tracker damage(width, height);
+		rects.track_damage(&damage);
 
+		SfmlFont font(opengl, "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf");
 
+		glyph_atlas glyphs;
+		auto font_id = glyphs.add_font(&font);
+		text_renderer texts(rects, glyphs);
 
-	/*sf::RenderWindow window(sf::VideoMode(800, 600), "My window");
-	RectangleRenderer renderer(window);
+		texture_atlas images;
+		rects.image_texture(images.texture());
 
+		RectangleRenderer renderer(rects);
+		GuiMananger gui_data(renderer, texts, images, {float(width), float(height)});
 
-	GuiMananger gui_data(renderer);
+		auto button = gui_data.add_button({100.f, 100.f}, {200.f, 200.f}, sf::Color::Red);
+		button.display().color() = sf::Color::Blue;
 
-	auto button = gui_data.add_button({100.f, 100.f}, {200.f, 200.f}, sf::Color::Red);
-	button.display().color() = sf::Color::Blue;
+		auto child_button = gui_data.add_button({30.0f, 0.0f}, {100.0f, 100.0f}, sf::Color::Red, button.spatial().spatial());
+		child_button.display().corner_radius() = 10;
 
-	auto child_button = gui_data.add_button({30.0f, 0.0f}, {100.0f, 100.0f}, sf::Color::Red, button.spatial().spatial());
+		gui_data.add_label({10.0f, 10.0f}, "G'day, graf!", font_id, 20.0f, sf::Color::White, child_button.spatial().spatial());
 
+		// A small checkerboard
+		std::vector<GLubyte> checker_pixels(64 * 64 * 4);
+		for(GLuint y = 0; y < 64; ++y)
+		{
+			for(GLuint x = 0; x < 64; ++x)
+			{
+				GLubyte value = ((x / 8 + y / 8) % 2) ? 255 : 64;
+				GLubyte *pixel = &checker_pixels[(y * 64 + x) * 4];
+				pixel[0] = value;
+				pixel[1] = value;
+				pixel[2] = value;
+				pixel[3] = 255;
+			}
+		}
+		auto checker = images.add(64, 64, checker_pixels.data());
+		gui_data.add_image({400.0f, 100.0f}, {128.0f, 128.0f}, checker);
 
+		// Only the rows that fit into the view are materialized
+		NumberedRows rows(gui_data, font_id, 100000);
+		auto &scroll_view = gui_data.add_scroll_view({560.0f, 100.0f}, {200.0f, 400.0f}, 20.0f, rows);
+		scroll_view.scroll_to(50000 * 20.0f + 10.0f);
 
-	// run the program as long as the window is open
-	while (window.isOpen())
-	{
-		gui_data.update();
+		glClearColor(0.5, 0, 0, 1);
 
-		// check all the window's events that were triggered since the last iteration of the loop
-		sf::Event event;
-		while (window.pollEvent(event))
+		// Rendering only happens on demand: if nothing has changed and nothing is animated, we
+		// sleep until the next event arrives
+		bool idle = false;
+		while(idle ? render_win.wait_events() : render_win.process_events())
 		{
-			// "close requested" event: we close the window
-			if (event.type == sf::Event::Closed)
-				window.close();
+			if(render_win.exposed())
+				damage.add_all();
 
-			if (event.type == sf::Event::MouseButtonPressed)
+			// Everything that depends on the window size follows resizes
+			if(render_win.width() != width || render_win.height() != height)
 			{
-				if(event.mouseButton.button == sf::Mouse::Left)
-				{
-					gui_data.input().mouse_button_press(MouseButton::left, red::vector2f(event.mouseButton.x, event.mouseButton.y));
-				}
+				width = render_win.width();
+				height = render_win.height();
+				glViewport(0, 0, width, height);
+				damage.resize(width, height);
+				gui_data.viewport({float(width), float(height)});
 			}
-		}
 
-		if(child_button.input().events() & focus)
-			child_button.display().color() = sf::Color::Green;
+			gui_data.update();
+			gui_data.render();
 
-		if(child_button.input().events() & blur)
-			child_button.display().color() = sf::Color::Red;
+			// Until all shaders are linked we only show the cleared screen
+			if(!shaders.poll())
+			{
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				render_win.swap_buffers();
+				damage.add_all();
+				continue;
+			}
 
-		gui_data.render();
+			// Only the damaged regions are redrawn and presented
+			auto const &regions = damage.regions(render_win.buffer_age());
+			if(!regions.empty())
+			{
+				glEnable(GL_SCISSOR_TEST);
+				for(auto const &region: regions)
+				{
+					glScissor(region.x, height - region.y - region.height, region.width, region.height);
+					glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+					renderer.display(width, height);
+				}
+				glDisable(GL_SCISSOR_TEST);
+
+				render_win.swap_buffers(regions.data(), regions.size());
+
+				// If nothing has been presented the damage carries over to the next frame
+				damage.next_frame();
+			}
 
-		window.clear();
-		renderer.display();
-		renderer.clear();
-		window.display();
-	}*/
+			// Without damage and running animations nothing changes until the next event
+			idle = damage.empty() && !gui_data.animating();
+		}
+	}
+	catch(::std::exception const &e)
+	{
+		GRAF_ERROR_MSG("Unhandled exception: {}\n", e.what());
+	}
 
 
 	return 0;
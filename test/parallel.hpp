@@ -0,0 +1,386 @@
+/**************************************************************************************************
+ * graf library                                                                                   *
+ * Copyright © 2012 David Kretzmer                                                                *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction,including without limitation the rights to use, copy, modify, merge, publish,      *
+ * distribute,sublicense, and/or sell copies of the Software, and to permit persons to whom the   *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <light/utility/non_copyable.hpp>
+
+#include "catalog_set.hpp"
+
+
+/// A fixed set of worker threads that run the tasks of one job at a time. Each thread has its
+/// own queue of tasks. A thread takes tasks from the front of its own queue and, once it is
+/// empty, steals from the back of the other queues, so threads that finish early take over
+/// work from slower ones.
+class ThreadPool : light::non_copyable
+{
+public:
+	/// A job consists of tasks numbered from 0 that can run in parallel
+	class Job
+	{
+	public:
+		virtual ~Job() {}
+		/// Runs a single task. Must not throw.
+		virtual void run(size_t task) = 0;
+	};
+
+	/// Creates a pool with the given number of worker threads. The thread calling run() works
+	/// on the job as well, so by default there is one worker less than hardware threads.
+	explicit ThreadPool(size_t num_workers = default_workers()) :
+		m_queues(new Queue[num_workers + 1]),
+		m_num_queues(num_workers + 1),
+		m_job(nullptr),
+		m_remaining(0),
+		m_generation(0),
+		m_stop(false)
+	{
+		for(size_t i = 0; i < num_workers; i++)
+			m_threads.push_back(std::thread(&ThreadPool::work, this, i));
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_wake.notify_all();
+
+		for(auto &thread: m_threads)
+			thread.join();
+	}
+
+	/// Returns the number of threads that work on a job, including the calling one
+	size_t concurrency() const { return m_num_queues; }
+
+	/// Runs the tasks 0 to num_tasks - 1 of the job and returns when all of them are done.
+	/// Every thread starts with a contiguous block of tasks, so neighbouring tasks usually run
+	/// on the same thread. Jobs from different threads are run one after the other. Jobs
+	/// started from a task of this pool run on the calling thread, since the pool is busy with
+	/// the outer job.
+	void run(Job &job, size_t num_tasks)
+	{
+		if(current_pool() == this)
+		{
+			for(size_t task = 0; task < num_tasks; task++)
+				job.run(task);
+			return;
+		}
+
+		std::lock_guard<std::mutex> run_lock(m_run_mutex);
+		if(!num_tasks)
+			return;
+
+		// The job is published before any task, so a thread that finds a task also finds the
+		// job it belongs to
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_job = &job;
+			m_remaining = num_tasks;
+		}
+
+		for(size_t q = 0; q < m_num_queues; q++)
+		{
+			std::lock_guard<std::mutex> lock(m_queues[q].m_mutex);
+			for(size_t task = q * num_tasks / m_num_queues; task < (q + 1) * num_tasks / m_num_queues; task++)
+				m_queues[q].m_tasks.push_back(task);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			++m_generation;
+		}
+		m_wake.notify_all();
+
+		// The calling thread uses the last queue
+		current_pool() = this;
+		process(m_num_queues - 1);
+		current_pool() = nullptr;
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while(m_remaining)
+			m_done.wait(lock);
+		m_job = nullptr;
+	}
+
+	/// A pool shared by everything that doesn't need its own
+	static ThreadPool& shared()
+	{
+		static ThreadPool pool;
+		return pool;
+	}
+
+private:
+	struct Queue
+	{
+		std::mutex m_mutex;
+		std::deque<size_t> m_tasks;
+	};
+
+	std::unique_ptr<Queue[]> m_queues;
+	size_t m_num_queues;
+	std::vector<std::thread> m_threads;
+
+	Job *m_job;
+	std::atomic<size_t> m_remaining;
+
+	/// Protects the generation and the stop flag and is used to wait for them and for the end
+	/// of a job
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	size_t m_generation;
+	bool m_stop;
+
+	std::mutex m_run_mutex;
+
+	/// The pool whose tasks the calling thread is running, if any
+	static ThreadPool*& current_pool()
+	{
+		static thread_local ThreadPool *pool = nullptr;
+		return pool;
+	}
+
+	static size_t default_workers()
+	{
+		size_t const hardware = std::thread::hardware_concurrency();
+		return hardware > 1 ? hardware - 1 : 0;
+	}
+
+	bool pop(size_t q, size_t *task)
+	{
+		std::lock_guard<std::mutex> lock(m_queues[q].m_mutex);
+		if(m_queues[q].m_tasks.empty())
+			return false;
+
+		*task = m_queues[q].m_tasks.front();
+		m_queues[q].m_tasks.pop_front();
+		return true;
+	}
+
+	bool steal(size_t q, size_t *task)
+	{
+		for(size_t i = 1; i < m_num_queues; i++)
+		{
+			Queue &victim = m_queues[(q + i) % m_num_queues];
+
+			std::lock_guard<std::mutex> lock(victim.m_mutex);
+			if(!victim.m_tasks.empty())
+			{
+				*task = victim.m_tasks.back();
+				victim.m_tasks.pop_back();
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	/// Runs tasks until all queues are empty
+	void process(size_t q)
+	{
+		size_t task;
+		while(pop(q, &task) || steal(q, &task))
+		{
+			m_job->run(task);
+
+			if(m_remaining.fetch_sub(1) == 1)
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_done.notify_all();
+			}
+		}
+	}
+
+	void work(size_t q)
+	{
+		current_pool() = this;
+
+		size_t generation = 0;
+		while(true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				while(!m_stop && m_generation == generation)
+					m_wake.wait(lock);
+
+				if(m_stop)
+					return;
+				generation = m_generation;
+			}
+
+			process(q);
+		}
+	}
+};
+
+
+/// Elements are split into chunks of at least this many elements. Smaller ranges are not
+/// worth waking up other threads for.
+static size_t const min_chunk_size = 4096;
+
+/// Returns the number of elements of type T after which a column is at a cache line boundary
+/// again. This is always a power of two.
+template<typename T>
+size_t elements_per_line()
+{
+	size_t bytes = sizeof(T);
+	size_t elements = cache_line_size;
+	while(!(bytes % 2) && elements > 1)
+	{
+		bytes /= 2;
+		elements /= 2;
+	}
+	return elements;
+}
+
+/// Returns the number of elements per chunk for a range of num elements. The size is a
+/// multiple of alignment and there are a few chunks per thread, so stealing can balance the
+/// load.
+inline size_t chunk_size(ThreadPool const &pool, size_t num, size_t alignment)
+{
+	size_t size = std::max(min_chunk_size, num / (pool.concurrency() * 4));
+	return (size + alignment - 1) / alignment * alignment;
+}
+
+
+/// Splits a range into chunks and calls fn(begin, end) for each of them
+template<typename TFunction>
+class RangeJob : public ThreadPool::Job
+{
+public:
+	RangeJob(size_t num, size_t chunk_size, TFunction const &fn) :
+		m_num(num),
+		m_chunk_size(chunk_size),
+		m_fn(fn) {}
+
+	size_t num_chunks() const { return (m_num + m_chunk_size - 1) / m_chunk_size; }
+
+	void run(size_t chunk)
+	{
+		size_t const begin = chunk * m_chunk_size;
+		m_fn(begin, std::min(begin + m_chunk_size, m_num));
+	}
+
+private:
+	size_t m_num;
+	size_t m_chunk_size;
+	TFunction const &m_fn;
+};
+
+/// Calls fn(begin, end) for chunks of the range [0, num) on the threads of the pool. Chunk
+/// boundaries are multiples of alignment elements. fn is shared by all threads and called as a
+/// const object, so it has to be safe to call concurrently for different chunks. Ranges that fit
+/// into a single chunk are run on the calling thread.
+template<typename TFunction>
+void parallel_for(ThreadPool &pool, size_t num, size_t alignment, TFunction const &fn)
+{
+	RangeJob<TFunction> job(num, chunk_size(pool, num, alignment), fn);
+
+	if(job.num_chunks() > 1)
+		pool.run(job, job.num_chunks());
+	else if(num)
+		fn(size_t(0), num);
+}
+
+
+/// A list of indices to unpack a tuple in a function call
+template<size_t ...Indices>
+struct IndexList {};
+
+template<size_t N, size_t ...Indices>
+struct MakeIndexList : MakeIndexList<N - 1, N - 1, Indices...> {};
+
+template<size_t ...Indices>
+struct MakeIndexList<0, Indices...>
+{
+	typedef IndexList<Indices...> type;
+};
+
+/// Calls fn(index, values...) for every element of a chunk, with the element's value of each
+/// column
+template<typename TFunction, typename ...TColumns>
+class ElementFunction
+{
+public:
+	ElementFunction(TFunction const &fn, TColumns *...columns) :
+		m_fn(fn),
+		m_columns(columns...) {}
+
+	void operator () (size_t begin, size_t end) const
+	{
+		call(begin, end, typename MakeIndexList<sizeof...(TColumns)>::type());
+	}
+
+private:
+	TFunction const &m_fn;
+	std::tuple<TColumns*...> m_columns;
+
+	template<size_t ...Indices>
+	void call(size_t begin, size_t end, IndexList<Indices...>) const
+	{
+		for(size_t i = begin; i < end; i++)
+			m_fn(i, std::get<Indices>(m_columns)[i]...);
+	}
+};
+
+template<typename TFunction, typename ...TColumns>
+ElementFunction<TFunction, TColumns...> element_function(TFunction const &fn, TColumns *...columns)
+{
+	return ElementFunction<TFunction, TColumns...>(fn, columns...);
+}
+
+/// Calls fn(index, values...) for every element of the catalog on the threads of the pool,
+/// where values are the element's values of the given columns, e.g.
+///
+///     parallel_for_each<Position, Clip>(pool, catalog, cull);
+///
+/// Chunks start at cache line boundaries in all columns, so no two threads write to the same
+/// line. The dirty bits of single elements can't be set concurrently, so the columns are fetched
+/// with CatalogSet::data<T>(), which marks them as changed as a whole if the catalog isn't
+/// const. A const catalog only hands out read-only columns and nothing is marked. fn has to be
+/// safe to call concurrently for different elements.
+template<typename ...TColumns, typename TCatalog, typename TFunction>
+void parallel_for_each(ThreadPool &pool, TCatalog &catalog, TFunction const &fn)
+{
+	size_t const alignment = std::max({size_t(1), elements_per_line<TColumns>()...});
+
+	// Marks the columns of a non-const catalog before any thread writes to them
+	auto chunk_fn = element_function(fn, catalog.template data<TColumns>()...);
+	parallel_for(pool, catalog.size(), alignment, chunk_fn);
+}
+
+/// Runs on the shared pool
+template<typename ...TColumns, typename TCatalog, typename TFunction>
+void parallel_for_each(TCatalog &catalog, TFunction const &fn)
+{
+	parallel_for_each<TColumns...>(ThreadPool::shared(), catalog, fn);
+}
@@ -0,0 +1,294 @@
+/**************************************************************************************************
+ * graf library                                                                                   *
+ * Copyright © 2012 David Kretzmer                                                                *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction,including without limitation the rights to use, copy, modify, merge, publish,      *
+ * distribute,sublicense, and/or sell copies of the Software, and to permit persons to whom the   *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <light/light.hpp>
+#include <light/diagnostics/errors.hpp>
+#include <light/utility/non_copyable.hpp>
+
+#ifdef LIGHT_PLATFORM_LINUX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+/// The layout of a snapshot file:
+///
+///     SnapshotHeader
+///     SnapshotSection[num_sections]
+///     section data, each section starts at a multiple of snapshot_alignment
+///
+/// Sections are plain arrays, so a mapped snapshot can be used without copying anything. All
+/// values are stored in the byte order of the machine that wrote the snapshot.
+static char const snapshot_magic[8] = {'G', 'R', 'A', 'F', 'C', 'A', 'T', '\0'};
+
+/// Incremented whenever the layout changes
+static std::uint32_t const snapshot_version = 1;
+
+/// Sections start on cache lines, like catalog columns do
+static size_t const snapshot_alignment = 64;
+
+struct SnapshotHeader
+{
+	char m_magic[8];
+	std::uint32_t m_version;
+	std::uint32_t m_num_sections;
+	std::uint64_t m_num_elements;
+	/// Head of the handle translator's free list
+	std::uint32_t m_next_handle;
+	std::uint32_t m_reserved;
+};
+
+struct SnapshotSection
+{
+	std::uint64_t m_offset;
+	std::uint64_t m_element_size;
+	std::uint64_t m_count;
+};
+
+
+//=================================================================================================
+//
+//=================================================================================================
+/// Writes a snapshot file section by section. The section table is reserved up front and
+/// written by finish(), once the offsets of all sections are known.
+class SnapshotWriter : light::non_copyable
+{
+public:
+	SnapshotWriter(char const *path, size_t num_sections) :
+		m_file(std::fopen(path, "wb")),
+		m_sections(num_sections),
+		m_next_section(0),
+		m_offset(0)
+	{
+		if(!m_file)
+			throw light::runtime_error("Could not open snapshot for writing");
+
+		SnapshotHeader header = SnapshotHeader();
+		SnapshotSection section = SnapshotSection();
+		write(&header, sizeof(header));
+		for(size_t i = 0; i < num_sections; i++)
+			write(&section, sizeof(section));
+	}
+
+	~SnapshotWriter()
+	{
+		if(m_file)
+			std::fclose(m_file);
+	}
+
+	/// Starts a new section of count elements
+	void begin_section(size_t element_size, size_t count)
+	{
+		assert(m_next_section < m_sections.size());
+
+		pad(snapshot_alignment);
+
+		SnapshotSection &section = m_sections[m_next_section++];
+		section.m_offset = m_offset;
+		section.m_element_size = element_size;
+		section.m_count = count;
+	}
+
+	void write(void const *data, size_t size)
+	{
+		if(size && std::fwrite(data, 1, size, m_file) != size)
+			throw light::runtime_error("Could not write snapshot");
+		m_offset += size;
+	}
+
+	/// Writes the header and the section table and closes the file
+	void finish(size_t num_elements, light::uint4 next_handle)
+	{
+		assert(m_next_section == m_sections.size());
+
+		SnapshotHeader header = SnapshotHeader();
+		std::memcpy(header.m_magic, snapshot_magic, sizeof(snapshot_magic));
+		header.m_version = snapshot_version;
+		header.m_num_sections = std::uint32_t(m_sections.size());
+		header.m_num_elements = num_elements;
+		header.m_next_handle = next_handle;
+
+		if(std::fseek(m_file, 0, SEEK_SET))
+			throw light::runtime_error("Could not write snapshot");
+		write(&header, sizeof(header));
+		if(!m_sections.empty())
+			write(&m_sections[0], m_sections.size() * sizeof(SnapshotSection));
+
+		std::FILE *file = m_file;
+		m_file = nullptr;
+		if(std::fclose(file))
+			throw light::runtime_error("Could not write snapshot");
+	}
+
+private:
+	std::FILE *m_file;
+	std::vector<SnapshotSection> m_sections;
+	size_t m_next_section;
+	size_t m_offset;
+
+	void pad(size_t alignment)
+	{
+		static char const zeros[snapshot_alignment] = {};
+		write(zeros, (alignment - m_offset % alignment) % alignment);
+	}
+};
+
+
+//=================================================================================================
+//
+//=================================================================================================
+/// A read-only file in memory. On Linux the file is mapped, so only the pages that are
+/// actually used are read, elsewhere it is read completely.
+class MappedFile : light::non_copyable
+{
+public:
+	explicit MappedFile(char const *path) :
+		m_data(nullptr),
+		m_size(0)
+	{
+#ifdef LIGHT_PLATFORM_LINUX
+		int fd = ::open(path, O_RDONLY);
+		if(fd < 0)
+			throw light::runtime_error("Could not open snapshot");
+
+		struct stat info;
+		if(::fstat(fd, &info) || !info.st_size)
+		{
+			::close(fd);
+			throw light::runtime_error("Could not read snapshot");
+		}
+
+		m_size = size_t(info.st_size);
+		void *data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+
+		if(data == MAP_FAILED)
+			throw light::runtime_error("Could not map snapshot");
+		m_data = static_cast<char const*>(data);
+#else
+		std::FILE *file = std::fopen(path, "rb");
+		if(!file)
+			throw light::runtime_error("Could not open snapshot");
+
+		std::fseek(file, 0, SEEK_END);
+		long const size = std::ftell(file);
+		std::fseek(file, 0, SEEK_SET);
+
+		// Blocks from new are aligned enough for the alignment of the sections to carry over
+		// to all value types
+		m_buffer.reset(new std::uint64_t[(size + 7) / 8]);
+		m_size = size > 0 ? size_t(size) : 0;
+		bool const ok = m_size && std::fread(m_buffer.get(), 1, m_size, file) == m_size;
+		std::fclose(file);
+
+		if(!ok)
+			throw light::runtime_error("Could not read snapshot");
+		m_data = reinterpret_cast<char const*>(m_buffer.get());
+#endif
+	}
+
+	~MappedFile()
+	{
+#ifdef LIGHT_PLATFORM_LINUX
+		if(m_data)
+			::munmap(const_cast<char*>(m_data), m_size);
+#endif
+	}
+
+	char const* data() const { return m_data; }
+	size_t size() const { return m_size; }
+
+private:
+	char const *m_data;
+	size_t m_size;
+#ifndef LIGHT_PLATFORM_LINUX
+	std::unique_ptr<std::uint64_t[]> m_buffer;
+#endif
+};
+
+
+//=================================================================================================
+//
+//=================================================================================================
+/// Checks the header of a snapshot and gives access to its sections. Every section is checked
+/// against the file size and the expected element size, so a truncated or foreign file throws
+/// instead of being read out of bounds.
+class SnapshotReader
+{
+public:
+	SnapshotReader(MappedFile const &file, size_t num_sections) :
+		m_file(file)
+	{
+		if(file.size() < sizeof(SnapshotHeader) ||
+		   std::memcmp(header().m_magic, snapshot_magic, sizeof(snapshot_magic)))
+			throw light::runtime_error("Not a catalog snapshot");
+		if(header().m_version != snapshot_version)
+			throw light::runtime_error("Unsupported snapshot version");
+		if(header().m_num_sections != num_sections ||
+		   file.size() < sizeof(SnapshotHeader) + num_sections * sizeof(SnapshotSection))
+			throw light::runtime_error("Snapshot doesn't match the catalog");
+	}
+
+	size_t num_elements() const { return size_t(header().m_num_elements); }
+	light::uint4 next_handle() const { return header().m_next_handle; }
+
+	/// Returns the number of elements of a section
+	size_t count(size_t index) const { return size_t(section_entry(index).m_count); }
+
+	/// Returns the elements of a section, which have to be of type T
+	template<typename T>
+	T const* section(size_t index) const
+	{
+		SnapshotSection const &s = section_entry(index);
+
+		if(s.m_element_size != sizeof(T))
+			throw light::runtime_error("Snapshot doesn't match the catalog");
+		if(s.m_offset % snapshot_alignment || s.m_offset > m_file.size() ||
+		   s.m_count > (m_file.size() - s.m_offset) / sizeof(T))
+			throw light::runtime_error("Snapshot is truncated");
+
+		return reinterpret_cast<T const*>(m_file.data() + s.m_offset);
+	}
+
+private:
+	MappedFile const &m_file;
+
+	SnapshotHeader const& header() const
+	{
+		return *reinterpret_cast<SnapshotHeader const*>(m_file.data());
+	}
+
+	SnapshotSection const& section_entry(size_t index) const
+	{
+		assert(index < header().m_num_sections);
+		return reinterpret_cast<SnapshotSection const*>(m_file.data() + sizeof(SnapshotHeader))[index];
+	}
+};
@@ -0,0 +1,387 @@
+/**************************************************************************************************
+ * graf library                                                                                   *
+ * Copyright © 2012 David Kretzmer                                                                *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction,including without limitation the rights to use, copy, modify, merge, publish,      *
+ * distribute,sublicense, and/or sell copies of the Software, and to permit persons to whom the   *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include <cstdint>
+#include <cstdio>
+#include <tuple>
+#include <vector>
+
+#include <light/light.hpp>
+
+#include "catalog_set.hpp"
+#include "check.hpp"
+
+
+namespace
+{
+	class UniqueType {};
+	typedef Handle<UniqueType> HandleType;
+
+	struct Value
+	{
+		int m_value;
+	};
+
+	struct Weight
+	{
+		float m_weight;
+	};
+
+	typedef CatalogSet<HandleType, Value, Weight> TestCatalog;
+
+	Value value(int v) { Value result = {v}; return result; }
+	Weight weight(float w) { Weight result = {w}; return result; }
+
+	bool greater_value(Value const &lhs, Value const &rhs) { return lhs.m_value > rhs.m_value; }
+
+	/// Adds num elements whose values are their indices
+	std::vector<HandleType> fill(TestCatalog &catalog, int num)
+	{
+		std::vector<HandleType> handles;
+		for(int i = 0; i < num; ++i)
+			handles.push_back(catalog.add(value(i), weight(float(i))));
+		return handles;
+	}
+
+	/// Checks that every handle refers to the element with the given value
+	bool resolve(TestCatalog const &catalog, std::vector<HandleType> const &handles, std::vector<int> const &expected)
+	{
+		TEST_CHECK(handles.size() == expected.size());
+		for(size_t i = 0; i < handles.size(); ++i)
+		{
+			TEST_CHECK(catalog.contains(handles[i]));
+			TEST_CHECK(catalog.get<Value>(handles[i]).m_value == expected[i]);
+			TEST_CHECK(catalog.get_handle(catalog.get_index(handles[i])) == handles[i]);
+		}
+		return true;
+	}
+}
+
+
+//=================================================================================================
+// Batched elements are merged in at their positions, elements queued for the same position
+// keep their order, and all handles resolve afterwards
+//=================================================================================================
+static bool batch_add_commit()
+{
+	TestCatalog catalog;
+	std::vector<HandleType> handles = fill(catalog, 4);
+
+	handles.push_back(catalog.batch_add(2, value(20), weight(0.0f)));
+	handles.push_back(catalog.batch_add(0, value(10), weight(0.0f)));
+	handles.push_back(catalog.batch_add(2, value(21), weight(0.0f)));
+	handles.push_back(catalog.batch_add(4, value(40), weight(0.0f)));
+	catalog.commit_batch();
+
+	int const order[] = {10, 0, 1, 20, 21, 2, 3, 40};
+	TEST_CHECK(catalog.size() == 8);
+	for(size_t i = 0; i < catalog.size(); ++i)
+		TEST_CHECK(catalog.at<Value>(i).m_value == order[i]);
+
+	int const expected[] = {0, 1, 2, 3, 20, 10, 21, 40};
+	TEST_CHECK(resolve(catalog, handles, std::vector<int>(expected, expected + 8)));
+
+	// Committing an empty batch changes nothing
+	size_t const version = catalog.layout_version();
+	catalog.commit_batch();
+	TEST_CHECK(catalog.layout_version() == version);
+
+	return true;
+}
+
+
+//=================================================================================================
+// Nothing may move elements while a batch is open, since the queued positions and handles refer
+// to the current layout
+//=================================================================================================
+static bool no_structural_change_in_batch()
+{
+	TestCatalog catalog;
+	std::vector<HandleType> handles = fill(catalog, 4);
+	catalog.mark_dead(handles[1]);
+
+	catalog.batch_add(1, value(10), weight(0.0f));
+
+	int thrown = 0;
+	try { catalog.add(value(5), weight(0.0f)); } catch(light::runtime_error const &) { ++thrown; }
+	try { catalog.add(0, 1, nullptr, nullptr, nullptr); } catch(light::runtime_error const &) { ++thrown; }
+	try { catalog.swap_remove(handles[0]); } catch(light::runtime_error const &) { ++thrown; }
+	try { catalog.erase(0, 1); } catch(light::runtime_error const &) { ++thrown; }
+	try { catalog.compact(); } catch(light::runtime_error const &) { ++thrown; }
+	try { catalog.apply_permutation(std::vector<size_t>(4, 0)); } catch(light::runtime_error const &) { ++thrown; }
+	TEST_CHECK(thrown == 6);
+
+	// The catalog is untouched and the batch can still be committed
+	TEST_CHECK(catalog.size() == 4);
+	catalog.commit_batch();
+	TEST_CHECK(catalog.size() == 5);
+	TEST_CHECK(catalog.at<Value>(1).m_value == 10);
+
+	catalog.compact();
+	int const expected[] = {0, 2, 3};
+	std::vector<HandleType> remaining;
+	remaining.push_back(handles[0]);
+	remaining.push_back(handles[2]);
+	remaining.push_back(handles[3]);
+	TEST_CHECK(resolve(catalog, remaining, std::vector<int>(expected, expected + 3)));
+
+	return true;
+}
+
+
+//=================================================================================================
+// Handles of removed elements become stale, even after their entries have been reused
+//=================================================================================================
+static bool stale_handles()
+{
+	TestCatalog catalog;
+	std::vector<HandleType> handles = fill(catalog, 4);
+
+	HandleType const removed = handles[1];
+	catalog.swap_remove(removed);
+	TEST_CHECK(!catalog.contains(removed));
+
+	bool thrown = false;
+	try { catalog.get_index(removed); } catch(light::runtime_error const &) { thrown = true; }
+	TEST_CHECK(thrown);
+
+	// The entry is reused with a newer generation
+	HandleType const reused = catalog.add(value(10), weight(0.0f));
+	TEST_CHECK(reused.index() == removed.index());
+	TEST_CHECK(reused.generation() != removed.generation());
+	TEST_CHECK(catalog.contains(reused));
+	TEST_CHECK(!catalog.contains(removed));
+
+	thrown = false;
+	try { catalog.get<Value>(removed); } catch(light::runtime_error const &) { thrown = true; }
+	TEST_CHECK(thrown);
+
+	TEST_CHECK(!catalog.contains(HandleType()));
+
+	return true;
+}
+
+
+//=================================================================================================
+// Removing elements in any way keeps the handles of the remaining ones valid
+//=================================================================================================
+static bool removal_keeps_handles()
+{
+	TestCatalog catalog;
+	std::vector<HandleType> handles = fill(catalog, 10);
+
+	// Moves the last element to index 2
+	catalog.swap_remove(handles[2]);
+	TEST_CHECK(catalog.at<Value>(2).m_value == 9);
+
+	// Removes the values 3 and 4
+	catalog.erase(3, 2);
+
+	catalog.mark_dead(handles[0]);
+	catalog.mark_dead(handles[7]);
+	TEST_CHECK(catalog.num_dead() == 2);
+	TEST_CHECK(catalog.contains(handles[0]));
+	catalog.compact();
+	TEST_CHECK(catalog.num_dead() == 0);
+
+	int const order[] = {1, 9, 5, 6, 8};
+	TEST_CHECK(catalog.size() == 5);
+	for(size_t i = 0; i < catalog.size(); ++i)
+		TEST_CHECK(catalog.at<Value>(i).m_value == order[i]);
+
+	int const removed[] = {0, 2, 3, 4, 7};
+	for(int i: removed)
+		TEST_CHECK(!catalog.contains(handles[i]));
+
+	std::vector<HandleType> remaining;
+	std::vector<int> expected;
+	for(int i: order)
+	{
+		remaining.push_back(handles[i]);
+		expected.push_back(i);
+	}
+	TEST_CHECK(resolve(catalog, remaining, expected));
+
+	return true;
+}
+
+
+//=================================================================================================
+// Permuting and sorting moves the handles along with their elements
+//=================================================================================================
+static bool permutation_remaps_handles()
+{
+	TestCatalog catalog;
+	std::vector<HandleType> handles = fill(catalog, 6);
+	std::vector<int> expected;
+	for(int i = 0; i < 6; ++i)
+		expected.push_back(i);
+
+	// The element at perm[i] moves to index i
+	size_t const perm[] = {3, 0, 5, 1, 4, 2};
+	catalog.apply_permutation(std::vector<size_t>(perm, perm + 6));
+	for(size_t i = 0; i < catalog.size(); ++i)
+	{
+		TEST_CHECK(catalog.at<Value>(i).m_value == int(perm[i]));
+		TEST_CHECK(catalog.at<Weight>(i).m_weight == float(perm[i]));
+	}
+	TEST_CHECK(resolve(catalog, handles, expected));
+
+	catalog.sort_by<Value>(greater_value);
+	for(size_t i = 0; i < catalog.size(); ++i)
+		TEST_CHECK(catalog.at<Value>(i).m_value == int(5 - i));
+	TEST_CHECK(resolve(catalog, handles, expected));
+
+	return true;
+}
+
+
+//=================================================================================================
+// Mutable accessors mark tracked columns as dirty, const ones and other columns don't
+//=================================================================================================
+static bool dirty_tracking()
+{
+	TestCatalog catalog;
+	std::vector<HandleType> handles = fill(catalog, 200);
+	TestCatalog const &const_catalog = catalog;
+
+	catalog.track_changes<Value>();
+	TEST_CHECK(catalog.next_dirty<Value>(0) == 0);
+	catalog.clear_dirty<Value>();
+	TEST_CHECK(catalog.next_dirty<Value>(0) == catalog.size());
+
+	// Untracked columns are always dirty
+	TEST_CHECK(catalog.is_dirty<Weight>(5));
+
+	// Read-only access and other columns don't mark anything
+	(void)const_catalog.get<Value>(handles[3]);
+	(void)const_catalog.at<Value>(4);
+	(void)const_catalog.data<Value>();
+	(void)catalog.view<Value const, Weight>(0, catalog.size());
+	catalog.get<Weight>(handles[5]).m_weight = 1.0f;
+	catalog.at<Weight>(6).m_weight = 1.0f;
+	TEST_CHECK(catalog.next_dirty<Value>(0) == catalog.size());
+
+	catalog.get<Value>(handles[70]).m_value = 0;
+	catalog.at<Value>(130).m_value = 0;
+	TEST_CHECK(catalog.next_dirty<Value>(0) == 70);
+	TEST_CHECK(catalog.next_dirty<Value>(71) == 130);
+	TEST_CHECK(catalog.next_dirty<Value>(131) == catalog.size());
+	TEST_CHECK(catalog.is_dirty<Value>(70));
+	TEST_CHECK(!catalog.is_dirty<Value>(71));
+
+	catalog.clear_dirty<Value>();
+	catalog.view<Value, Weight const>(10, 20);
+	TEST_CHECK(catalog.next_dirty<Value>(0) == 10);
+	TEST_CHECK(catalog.is_dirty<Value>(19));
+	TEST_CHECK(catalog.next_dirty<Value>(20) == catalog.size());
+
+	// Whole columns
+	catalog.clear_dirty<Value>();
+	catalog.begin<Value>();
+	TEST_CHECK(catalog.is_dirty<Value>(0) && catalog.is_dirty<Value>(199));
+
+	catalog.clear_dirty<Value>();
+	catalog.data<Value>();
+	TEST_CHECK(catalog.is_dirty<Value>(0) && catalog.is_dirty<Value>(199));
+
+	// Elements that change their indices are dirty as well
+	catalog.clear_dirty<Value>();
+	catalog.swap_remove(handles[0]);
+	TEST_CHECK(catalog.is_dirty<Value>(0) && catalog.is_dirty<Value>(198));
+
+	return true;
+}
+
+
+//=================================================================================================
+// Views iterate over a range of elements and give access to all their columns
+//=================================================================================================
+static bool zip_view()
+{
+	TestCatalog catalog;
+	fill(catalog, 10);
+
+	auto view = catalog.view<Value, Weight const>(2, 8);
+	TEST_CHECK(view.size() == 6);
+
+	size_t count = 0;
+	for(auto it = view.begin(); it != view.end(); ++it)
+	{
+		TEST_CHECK(it.index() == count);
+		TEST_CHECK(std::get<0>(*it).m_value == int(count + 2));
+		TEST_CHECK(std::get<1>(*it).m_weight == float(count + 2));
+		std::get<0>(*it).m_value *= 10;
+		++count;
+	}
+	TEST_CHECK(count == 6);
+
+	TEST_CHECK(view.get<Value>(0).m_value == 20);
+	TEST_CHECK(view.column<Weight const>()[5].m_weight == 7.0f);
+	TEST_CHECK(std::get<0>(view[5]).m_value == 70);
+
+	// Changes are visible in the catalog, elements outside the view are untouched
+	TEST_CHECK(catalog.at<Value>(1).m_value == 1);
+	TEST_CHECK(catalog.at<Value>(2).m_value == 20);
+	TEST_CHECK(catalog.at<Value>(7).m_value == 70);
+	TEST_CHECK(catalog.at<Value>(8).m_value == 8);
+
+	TestCatalog const &const_catalog = catalog;
+	auto const_view = const_catalog.view<Value, Weight>(0, 10);
+	TEST_CHECK(const_view.get<Value const>(3).m_value == 30);
+
+	return true;
+}
+
+
+//=================================================================================================
+// Columns start on cache lines, so parallel chunks of different columns never share one
+//=================================================================================================
+static bool aligned_columns()
+{
+	TestCatalog catalog;
+	for(int num: {1, 3, 100, 1000})
+	{
+		fill(catalog, num);
+		TEST_CHECK(reinterpret_cast<std::uintptr_t>(catalog.data<Value>()) % cache_line_size == 0);
+		TEST_CHECK(reinterpret_cast<std::uintptr_t>(catalog.data<Weight>()) % cache_line_size == 0);
+	}
+
+	return true;
+}
+
+
+int main()
+{
+	bool ok = batch_add_commit();
+	ok = no_structural_change_in_batch() && ok;
+	ok = stale_handles() && ok;
+	ok = removal_keeps_handles() && ok;
+	ok = permutation_remaps_handles() && ok;
+	ok = dirty_tracking() && ok;
+	ok = zip_view() && ok;
+	ok = aligned_columns() && ok;
+	if(!ok)
+		return 1;
+
+	std::puts("catalog_set_test: ok");
+	return 0;
+}
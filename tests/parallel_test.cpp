@@ -0,0 +1,217 @@
+/**************************************************************************************************
+ * graf library                                                                                   *
+ * Copyright © 2012 David Kretzmer                                                                *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction,including without limitation the rights to use, copy, modify, merge, publish,      *
+ * distribute,sublicense, and/or sell copies of the Software, and to permit persons to whom the   *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include <light/light.hpp>
+
+#include "catalog_set.hpp"
+#include "parallel.hpp"
+#include "check.hpp"
+
+
+namespace
+{
+	/// Counts how often each index is visited and remembers chunks that don't start at a
+	/// multiple of the alignment
+	struct CountVisits
+	{
+		CountVisits(std::atomic<int> *visits, size_t alignment, std::atomic<int> *misaligned) :
+			m_visits(visits),
+			m_alignment(alignment),
+			m_misaligned(misaligned) {}
+
+		void operator () (size_t begin, size_t end) const
+		{
+			if(begin % m_alignment)
+				++*m_misaligned;
+			for(size_t i = begin; i < end; ++i)
+				++m_visits[i];
+		}
+
+		std::atomic<int> *m_visits;
+		size_t m_alignment;
+		std::atomic<int> *m_misaligned;
+	};
+
+	/// Runs a parallel_for on the same pool from every chunk and checks that it visits every
+	/// index once
+	struct RunNested
+	{
+		RunNested(ThreadPool &pool, size_t num_inner, std::atomic<size_t> *visited, std::atomic<int> *failures) :
+			m_pool(&pool),
+			m_num_inner(num_inner),
+			m_visited(visited),
+			m_failures(failures) {}
+
+		void operator () (size_t begin, size_t end) const
+		{
+			std::atomic<int> misaligned(0);
+			std::unique_ptr<std::atomic<int>[]> visits(new std::atomic<int>[m_num_inner]);
+			for(size_t i = 0; i < m_num_inner; ++i)
+				visits[i] = 0;
+
+			parallel_for(*m_pool, m_num_inner, 1, CountVisits(visits.get(), 1, &misaligned));
+
+			for(size_t i = 0; i < m_num_inner; ++i)
+			{
+				if(visits[i] != 1)
+					++*m_failures;
+			}
+			*m_visited += end - begin;
+		}
+
+		ThreadPool *m_pool;
+		size_t m_num_inner;
+		std::atomic<size_t> *m_visited;
+		std::atomic<int> *m_failures;
+	};
+
+	class UniqueType {};
+
+	struct Value
+	{
+		int m_value;
+	};
+
+	struct Square
+	{
+		long m_square;
+	};
+}
+
+
+//=================================================================================================
+// Every index is visited exactly once, by chunks that start at a multiple of the alignment
+//=================================================================================================
+static bool parallel_for_covers_range()
+{
+	ThreadPool pool(3);
+
+	size_t const sizes[] = {0, 1, min_chunk_size - 1, min_chunk_size, min_chunk_size + 1, 3 * min_chunk_size + 17, 100003};
+	size_t const alignments[] = {1, 3, 16, 64};
+
+	for(size_t num: sizes)
+	{
+		for(size_t alignment: alignments)
+		{
+			std::unique_ptr<std::atomic<int>[]> visits(new std::atomic<int>[num + 1]);
+			for(size_t i = 0; i < num; ++i)
+				visits[i] = 0;
+			std::atomic<int> misaligned(0);
+
+			parallel_for(pool, num, alignment, CountVisits(visits.get(), alignment, &misaligned));
+
+			TEST_CHECK(misaligned == 0);
+			for(size_t i = 0; i < num; ++i)
+				TEST_CHECK(visits[i] == 1);
+		}
+	}
+
+	return true;
+}
+
+
+//=================================================================================================
+// A job started from a task of the same pool runs on the calling thread instead of waiting for
+// the pool, which is busy with the outer job
+//=================================================================================================
+static bool nested_run_returns()
+{
+	ThreadPool pool(3);
+	std::atomic<size_t> visited(0);
+	std::atomic<int> failures(0);
+
+	size_t const num_outer = 8 * min_chunk_size;
+	size_t const num_inner = 4 * min_chunk_size;
+	parallel_for(pool, num_outer, 1, RunNested(pool, num_inner, &visited, &failures));
+
+	TEST_CHECK(visited == num_outer);
+	TEST_CHECK(failures == 0);
+
+	// The pool still works afterwards
+	std::unique_ptr<std::atomic<int>[]> visits(new std::atomic<int>[num_inner]);
+	for(size_t i = 0; i < num_inner; ++i)
+		visits[i] = 0;
+	std::atomic<int> misaligned(0);
+	parallel_for(pool, num_inner, 1, CountVisits(visits.get(), 1, &misaligned));
+	for(size_t i = 0; i < num_inner; ++i)
+		TEST_CHECK(visits[i] == 1);
+
+	return true;
+}
+
+
+//=================================================================================================
+// parallel_for_each passes the values of each element and marks mutable columns as changed
+//=================================================================================================
+static bool parallel_for_each_visits_elements()
+{
+	CatalogSet<Handle<UniqueType>, Value, Square> catalog;
+	catalog.track_changes<Value>();
+	catalog.track_changes<Square>();
+
+	size_t const num = 3 * min_chunk_size + 5;
+	for(size_t i = 0; i < num; ++i)
+	{
+		Value value = {int(i)};
+		Square square = {0};
+		catalog.add(value, square);
+	}
+	catalog.clear_dirty<Value>();
+	catalog.clear_dirty<Square>();
+
+	parallel_for_each<Value, Square>(catalog, [](size_t index, Value const &value, Square &square)
+	{
+		square.m_square = long(value.m_value) * long(index);
+	});
+
+	for(size_t i = 0; i < num; ++i)
+		TEST_CHECK(catalog.at<Square>(i).m_square == long(i) * long(i));
+	TEST_CHECK(catalog.next_dirty<Square>(0) == 0);
+	TEST_CHECK(catalog.next_dirty<Value>(0) == 0);
+
+	// Const catalogs are only read
+	catalog.clear_dirty<Value>();
+	auto const &read_only = catalog;
+	std::atomic<long> sum(0);
+	parallel_for_each<Value>(read_only, [&sum](size_t, Value const &value) { sum += value.m_value; });
+	TEST_CHECK(sum == long(num) * long(num - 1) / 2);
+	TEST_CHECK(catalog.next_dirty<Value>(0) == catalog.size());
+
+	return true;
+}
+
+
+int main()
+{
+	bool ok = parallel_for_covers_range();
+	ok = nested_run_returns() && ok;
+	ok = parallel_for_each_visits_elements() && ok;
+	if(!ok)
+		return 1;
+
+	std::puts("parallel_test: ok");
+	return 0;
+}
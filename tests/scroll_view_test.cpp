@@ -0,0 +1,121 @@
+/**************************************************************************************************
+ * graf library                                                                                   *
+ * Copyright © 2012 David Kretzmer                                                                *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction,including without limitation the rights to use, copy, modify, merge, publish,      *
+ * distribute,sublicense, and/or sell copies of the Software, and to permit persons to whom the   *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include <algorithm>
+#include <cstdio>
+
+#include <light/light.hpp>
+#include <SFML/Graphics.hpp>
+
+#include "catalog_set.hpp"
+#include "gui.hpp"
+#include "check.hpp"
+
+
+/// Gives every row a child spatial, like a label would
+class ChildRows : public RowSource
+{
+public:
+	ChildRows(SpatialCatalog &spatials, InputCatalog &input) :
+		m_spatials(spatials),
+		m_input(input) {}
+
+	size_t num_rows() const override { return 1000; }
+
+	void create_row(size_t, SpatialCatalog::HandleType row) override
+	{
+		auto child = m_spatials.add(row, red::vector2f(), red::vector2f(10, 10));
+		m_input.add(m_spatials.get_index(child), InputCatalog::Event());
+	}
+
+	void bind_row(size_t, size_t) override {}
+
+private:
+	SpatialCatalog &m_spatials;
+	InputCatalog &m_input;
+};
+
+
+/// Does what GuiMananger::update() does with the catalogs involved
+static void update(SpatialCatalog &spatials, InputCatalog &input, ScrollViewCatalog &views)
+{
+	if(spatials.num_dead())
+	{
+		input.compact();
+		spatials.compact();
+		views.remove_detached();
+	}
+
+	views.update();
+	spatials.update();
+	input.update();
+}
+
+
+//=================================================================================================
+// Removing a scroll view's container, or an ancestor of it, must destroy the scroll view so it
+// does not update rows that are gone
+//=================================================================================================
+static bool remove_scroll_views()
+{
+	SpatialCatalog spatials(red::vector2f(800, 600));
+	InputCatalog input(spatials);
+	ScrollViewCatalog views(spatials, input);
+	ChildRows rows(spatials, input);
+
+	auto panel = spatials.add(SpatialCatalog::HandleType(), red::vector2f(), red::vector2f(400, 400));
+	input.add(spatials.get_index(panel), InputCatalog::Event());
+
+	auto inner = views.add(red::vector2f(10, 10), red::vector2f(200, 100), 20.0f, rows, panel).container();
+	auto &outer = views.add(red::vector2f(500, 10), red::vector2f(200, 100), 20.0f, rows, SpatialCatalog::HandleType());
+	outer.scroll_to(100.0f);
+	update(spatials, input, views);
+	TEST_CHECK(views.size() == 2);
+
+	// Removing the parent of a scroll view
+	spatials.remove(panel);
+	update(spatials, input, views);
+	TEST_CHECK(views.size() == 1);
+	TEST_CHECK(!spatials.contains(inner));
+	TEST_CHECK(spatials.contains(outer.container()));
+
+	outer.scroll_by(40.0f);
+	update(spatials, input, views);
+
+	// Removing the container itself
+	auto container = outer.container();
+	spatials.remove(container);
+	update(spatials, input, views);
+	TEST_CHECK(views.size() == 0);
+	TEST_CHECK(!spatials.contains(container));
+
+	return true;
+}
+
+
+int main()
+{
+	if(!remove_scroll_views())
+		return 1;
+
+	std::puts("scroll_view_test: ok");
+	return 0;
+}
@@ -0,0 +1,146 @@
+/**************************************************************************************************
+ * graf library                                                                                   *
+ * Copyright © 2012 David Kretzmer                                                                *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction,including without limitation the rights to use, copy, modify, merge, publish,      *
+ * distribute,sublicense, and/or sell copies of the Software, and to permit persons to whom the   *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include <cstdio>
+#include <vector>
+
+#include <graf/shelf_packer.hpp>
+
+#include "check.hpp"
+
+
+using graf::uint;
+
+
+namespace
+{
+	/// Fills a 100x100 packer with num full-width shelves of the given height
+	void fill(graf::shelf_packer &packer, uint num, uint height)
+	{
+		uint x, y, shelf;
+		for(uint i = 0; i < num; ++i)
+			packer.allocate(100, height, &x, &y, &shelf);
+	}
+}
+
+
+//=================================================================================================
+// Clearing the shelves at the top gives their height back, so higher shelves fit again
+//=================================================================================================
+static bool top_shelves_merge()
+{
+	graf::shelf_packer packer(100, 100);
+	fill(packer, 5, 20);
+	TEST_CHECK(packer.num_shelves() == 5);
+
+	uint x, y, shelf;
+	TEST_CHECK(!packer.allocate(10, 30, &x, &y, &shelf));
+
+	packer.clear_shelf(4);
+	TEST_CHECK(packer.num_shelves() == 4);
+	TEST_CHECK(!packer.allocate(10, 30, &x, &y, &shelf));
+
+	packer.clear_shelf(3);
+	TEST_CHECK(packer.num_shelves() == 3);
+	TEST_CHECK(packer.allocate(10, 30, &x, &y, &shelf));
+	TEST_CHECK(x == 0 && y == 60 && shelf == 3);
+
+	// Empty shelves below the cleared one are merged as well
+	packer.clear_shelf(1);
+	TEST_CHECK(packer.num_shelves() == 4);
+	packer.clear_shelf(2);
+	TEST_CHECK(packer.num_shelves() == 4);
+	packer.clear_shelf(3);
+	TEST_CHECK(packer.num_shelves() == 1);
+	TEST_CHECK(packer.allocate(100, 80, &x, &y, &shelf));
+	TEST_CHECK(y == 20 && shelf == 1);
+
+	return true;
+}
+
+
+//=================================================================================================
+// Cleared shelves in the middle keep their height and are reused by rectangles that fit
+//=================================================================================================
+static bool middle_shelves_stay()
+{
+	graf::shelf_packer packer(100, 100);
+	fill(packer, 5, 20);
+
+	packer.clear_shelf(2);
+	TEST_CHECK(packer.num_shelves() == 5);
+	TEST_CHECK(packer.shelf_height(2) == 20);
+
+	uint x, y, shelf;
+	TEST_CHECK(packer.allocate(50, 18, &x, &y, &shelf));
+	TEST_CHECK(x == 0 && y == 40 && shelf == 2);
+	TEST_CHECK(!packer.allocate(50, 21, &x, &y, &shelf));
+
+	return true;
+}
+
+
+//=================================================================================================
+// Whether a rectangle fits after clearing can be checked without clearing anything
+//=================================================================================================
+static bool fit_check()
+{
+	graf::shelf_packer packer(100, 100);
+	fill(packer, 4, 20);
+	fill(packer, 1, 10);
+
+	std::vector<bool> none;
+	TEST_CHECK(packer.could_allocate(100, 10, none));
+	TEST_CHECK(!packer.could_allocate(100, 11, none));
+	TEST_CHECK(!packer.could_allocate(101, 1, none));
+
+	// Shelves at the top add up
+	std::vector<bool> top(5, false);
+	top[3] = top[4] = true;
+	TEST_CHECK(packer.could_allocate(100, 40, top));
+	TEST_CHECK(!packer.could_allocate(100, 41, top));
+
+	// A shelf in the middle only takes rectangles up to its height
+	std::vector<bool> middle(5, false);
+	middle[1] = true;
+	TEST_CHECK(packer.could_allocate(100, 20, middle));
+	TEST_CHECK(!packer.could_allocate(100, 21, middle));
+
+	// Nothing has been changed
+	TEST_CHECK(packer.num_shelves() == 5);
+	uint x, y, shelf;
+	TEST_CHECK(!packer.allocate(1, 11, &x, &y, &shelf));
+
+	return true;
+}
+
+
+int main()
+{
+	bool ok = top_shelves_merge();
+	ok = middle_shelves_stay() && ok;
+	ok = fit_check() && ok;
+	if(!ok)
+		return 1;
+
+	std::puts("shelf_packer_test: ok");
+	return 0;
+}
@@ -0,0 +1,291 @@
+/**************************************************************************************************
+ * graf library                                                                                   *
+ * Copyright © 2012 David Kretzmer                                                                *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction,including without limitation the rights to use, copy, modify, merge, publish,      *
+ * distribute,sublicense, and/or sell copies of the Software, and to permit persons to whom the   *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <light/light.hpp>
+
+#include "catalog_set.hpp"
+#include "snapshot.hpp"
+#include "check.hpp"
+
+
+namespace
+{
+	class UniqueType {};
+	typedef Handle<UniqueType> HandleType;
+
+	struct Value
+	{
+		int m_value;
+	};
+
+	struct Weight
+	{
+		float m_weight;
+	};
+
+	typedef CatalogSet<HandleType, Value, Weight> TestCatalog;
+	typedef CatalogSnapshot<HandleType, Value, Weight> TestSnapshot;
+
+	/// Sections of a TestCatalog snapshot
+	size_t const handle_section = 2;
+	size_t const entry_section = 3;
+
+	char const snapshot_path[] = "snapshot_test.snap";
+	char const broken_path[] = "snapshot_test_broken.snap";
+
+	TestCatalog::HandleType add(TestCatalog &catalog, int v)
+	{
+		Value value = {v};
+		Weight weight = {v * 0.5f};
+		return catalog.add(value, weight);
+	}
+
+	std::vector<char> read_file(char const *path)
+	{
+		std::vector<char> bytes;
+		std::FILE *file = std::fopen(path, "rb");
+		if(file)
+		{
+			char buffer[4096];
+			size_t read;
+			while((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+				bytes.insert(bytes.end(), buffer, buffer + read);
+			std::fclose(file);
+		}
+		return bytes;
+	}
+
+	void write_file(char const *path, std::vector<char> const &bytes)
+	{
+		std::FILE *file = std::fopen(path, "wb");
+		if(!bytes.empty())
+			std::fwrite(bytes.data(), 1, bytes.size(), file);
+		std::fclose(file);
+	}
+
+	SnapshotSection section(std::vector<char> const &bytes, size_t index)
+	{
+		SnapshotSection result;
+		std::memcpy(&result, bytes.data() + sizeof(SnapshotHeader) + index * sizeof(SnapshotSection), sizeof(result));
+		return result;
+	}
+
+	/// Returns the given entry of the handle translator's section
+	HandleEntry* entry(std::vector<char> &bytes, size_t index)
+	{
+		return reinterpret_cast<HandleEntry*>(bytes.data() + section(bytes, entry_section).m_offset) + index;
+	}
+
+	/// Checks that loading the bytes throws and leaves the catalog as it is
+	bool rejected(std::vector<char> const &bytes, TestCatalog &catalog)
+	{
+		size_t const size = catalog.size();
+		size_t const version = catalog.layout_version();
+		HandleType const first = catalog.get_handle(0);
+
+		write_file(broken_path, bytes);
+		bool thrown = false;
+		try { catalog.load(broken_path); } catch(light::runtime_error const &) { thrown = true; }
+
+		TEST_CHECK(thrown);
+		TEST_CHECK(catalog.size() == size);
+		TEST_CHECK(catalog.layout_version() == version);
+		TEST_CHECK(catalog.get_handle(0) == first);
+		TEST_CHECK(catalog.get_index(first) == 0);
+		return true;
+	}
+
+	/// A catalog spanning several pages of handles, with removed elements in the free list
+	void fill(TestCatalog &catalog, std::vector<HandleType> &live, std::vector<HandleType> &removed)
+	{
+		std::vector<HandleType> handles;
+		for(int i = 0; i < 700; ++i)
+			handles.push_back(add(catalog, i));
+
+		for(size_t i = 0; i < handles.size(); ++i)
+		{
+			if(i % 7 == 3)
+			{
+				catalog.swap_remove(handles[i]);
+				removed.push_back(handles[i]);
+			}
+			else
+				live.push_back(handles[i]);
+		}
+
+		// Reused entries get newer generations
+		for(int i = 0; i < 20; ++i)
+			live.push_back(add(catalog, 1000 + i));
+	}
+}
+
+
+//=================================================================================================
+// Loading a snapshot restores values, handles, generations and the free list
+//=================================================================================================
+static bool round_trip()
+{
+	TestCatalog original;
+	std::vector<HandleType> live, removed;
+	fill(original, live, removed);
+	original.save(snapshot_path);
+
+	TestCatalog loaded;
+	add(loaded, -1);
+	loaded.load(snapshot_path);
+
+	TEST_CHECK(loaded.size() == original.size());
+	for(size_t i = 0; i < loaded.size(); ++i)
+	{
+		TEST_CHECK(loaded.at<Value>(i).m_value == original.at<Value>(i).m_value);
+		TEST_CHECK(loaded.at<Weight>(i).m_weight == original.at<Weight>(i).m_weight);
+		TEST_CHECK(loaded.get_handle(i) == original.get_handle(i));
+	}
+
+	for(auto h: live)
+	{
+		TEST_CHECK(loaded.contains(h));
+		TEST_CHECK(loaded.get_index(h) == original.get_index(h));
+	}
+	for(auto h: removed)
+		TEST_CHECK(!loaded.contains(h));
+
+	// Both catalogs hand out the same handles, so the free list has been restored
+	for(int i = 0; i < 300; ++i)
+		TEST_CHECK(add(loaded, i) == add(original, i));
+
+	// The snapshot can be used in place as well
+	MappedFile file(snapshot_path);
+	TestSnapshot snapshot(file);
+	TEST_CHECK(snapshot.size() == original.size() - 300);
+	for(auto h: live)
+		TEST_CHECK(snapshot.get<Value>(h).m_value == original.get<Value>(h).m_value);
+
+	bool thrown = false;
+	try { snapshot.get_index(removed.front()); } catch(light::runtime_error const &) { thrown = true; }
+	TEST_CHECK(thrown);
+
+	// Nothing may be loaded over an open batch
+	loaded.batch_add(0, Value(), Weight());
+	thrown = false;
+	try { loaded.load(snapshot_path); } catch(light::runtime_error const &) { thrown = true; }
+	TEST_CHECK(thrown);
+	loaded.commit_batch();
+
+	return true;
+}
+
+
+//=================================================================================================
+// Truncated files, unknown versions and broken handle entries throw without changing anything
+//=================================================================================================
+static bool broken_snapshots()
+{
+	TestCatalog original;
+	std::vector<HandleType> live, removed;
+	fill(original, live, removed);
+	original.save(snapshot_path);
+	std::vector<char> const bytes = read_file(snapshot_path);
+	TEST_CHECK(!bytes.empty());
+
+	TestCatalog catalog;
+	for(int i = 0; i < 10; ++i)
+		add(catalog, i);
+
+	// Truncated anywhere, including inside the header and the section table
+	size_t const cuts[] = {1, sizeof(SnapshotHeader) - 1, sizeof(SnapshotHeader) + 5,
+	                       size_t(section(bytes, 1).m_offset) + 10, bytes.size() - 1};
+	for(size_t cut: cuts)
+		TEST_CHECK(rejected(std::vector<char>(bytes.begin(), bytes.begin() + cut), catalog));
+
+	// A different version or no snapshot at all
+	std::vector<char> broken = bytes;
+	reinterpret_cast<SnapshotHeader*>(broken.data())->m_version = snapshot_version + 1;
+	TEST_CHECK(rejected(broken, catalog));
+
+	broken = bytes;
+	broken[0] = 'X';
+	TEST_CHECK(rejected(broken, catalog));
+
+	// An element's entry points at an index out of range
+	HandleType const h = live[5];
+	broken = bytes;
+	entry(broken, h.index())->m_index = light::uint4(original.size());
+	TEST_CHECK(rejected(broken, catalog));
+
+	// An element's entry points at another element
+	broken = bytes;
+	entry(broken, h.index())->m_index = light::uint4(original.get_index(live[6]));
+	TEST_CHECK(rejected(broken, catalog));
+
+	// An element's entry has been freed
+	broken = bytes;
+	++entry(broken, h.index())->m_generation;
+	TEST_CHECK(rejected(broken, catalog));
+
+	// A free entry is active, so there are more active entries than elements
+	HandleType const r = removed[3];
+	broken = bytes;
+	++entry(broken, r.index())->m_generation;
+	entry(broken, r.index())->m_index = 0;
+	TEST_CHECK(rejected(broken, catalog));
+
+	// The free list has a cycle
+	broken = bytes;
+	entry(broken, r.index())->m_index = r.index();
+	TEST_CHECK(rejected(broken, catalog));
+
+	// The free list starts out of range
+	broken = bytes;
+	reinterpret_cast<SnapshotHeader*>(broken.data())->m_next_handle = 1u << 30;
+	TEST_CHECK(rejected(broken, catalog));
+
+	// Two elements have swapped their handles
+	broken = bytes;
+	HandleType *handles = reinterpret_cast<HandleType*>(broken.data() + section(broken, handle_section).m_offset);
+	std::swap(handles[0], handles[1]);
+	TEST_CHECK(rejected(broken, catalog));
+
+	// The unmodified snapshot still loads
+	catalog.load(snapshot_path);
+	TEST_CHECK(catalog.size() == original.size());
+
+	return true;
+}
+
+
+int main()
+{
+	bool ok = round_trip();
+	ok = broken_snapshots() && ok;
+
+	std::remove(snapshot_path);
+	std::remove(broken_path);
+	if(!ok)
+		return 1;
+
+	std::puts("snapshot_test: ok");
+	return 0;
+}
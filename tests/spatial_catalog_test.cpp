@@ -0,0 +1,200 @@
+/**************************************************************************************************
+ * graf library                                                                                   *
+ * Copyright © 2012 David Kretzmer                                                                *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction,including without limitation the rights to use, copy, modify, merge, publish,      *
+ * distribute,sublicense, and/or sell copies of the Software, and to permit persons to whom the   *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include <light/light.hpp>
+#include <SFML/Graphics.hpp>
+
+#include "catalog_set.hpp"
+#include "gui.hpp"
+#include "check.hpp"
+
+
+//=================================================================================================
+// Removing the only child of an element and adding a new one before the catalog is compacted
+// must not link the new child to the removed one
+//=================================================================================================
+static bool remove_then_add_before_update()
+{
+	SpatialCatalog spatials(red::vector2f(800, 600));
+
+	auto parent = spatials.add(SpatialCatalog::HandleType(), red::vector2f(), red::vector2f(100, 100));
+	auto old_child = spatials.add(parent, red::vector2f(), red::vector2f(10, 10));
+	spatials.add(old_child, red::vector2f(), red::vector2f(1, 1));
+
+	spatials.remove(old_child);
+	TEST_CHECK(!spatials.has_children(parent));
+	TEST_CHECK(!spatials.last_child(parent).is_valid());
+
+	auto child = spatials.add(parent, red::vector2f(5, 5), red::vector2f(10, 10));
+	TEST_CHECK(!spatials.get<SpatialCatalog::Base>(child).m_predecessor.is_valid());
+	TEST_CHECK(spatials.first_child(parent) == child);
+	TEST_CHECK(spatials.last_child(parent) == child);
+
+	spatials.update();
+	spatials.compact();
+	spatials.update();
+
+	// Walking and removing siblings must only see live elements
+	auto sibling = spatials.add(parent, red::vector2f(), red::vector2f(10, 10));
+	TEST_CHECK(spatials.get<SpatialCatalog::Base>(sibling).m_predecessor == child);
+	spatials.remove(child);
+	spatials.compact();
+	spatials.update();
+
+	TEST_CHECK(spatials.first_child(parent) == sibling);
+	TEST_CHECK(!spatials.get<SpatialCatalog::Base>(sibling).m_predecessor.is_valid());
+
+	return true;
+}
+
+
+/// Checks that both catalogs store their elements in the same order with the same links. The
+/// x coordinate of each element's position identifies it.
+static bool same_layout(SpatialCatalog const &lhs, SpatialCatalog const &rhs, size_t num)
+{
+	for(size_t i = 0; i < num; ++i)
+	{
+		TEST_CHECK(lhs.at<SpatialCatalog::Position>(i).m_position.x() == rhs.at<SpatialCatalog::Position>(i).m_position.x());
+
+		auto const &lhs_base = lhs.at<SpatialCatalog::Base>(i);
+		auto const &rhs_base = rhs.at<SpatialCatalog::Base>(i);
+		TEST_CHECK(lhs_base.m_parent.is_valid() == rhs_base.m_parent.is_valid());
+		TEST_CHECK(lhs_base.m_predecessor.is_valid() == rhs_base.m_predecessor.is_valid());
+		TEST_CHECK(lhs_base.m_successor.is_valid() == rhs_base.m_successor.is_valid());
+		if(lhs_base.m_parent.is_valid())
+			TEST_CHECK(lhs.get_index(lhs_base.m_parent) == rhs.get_index(rhs_base.m_parent));
+		if(lhs_base.m_predecessor.is_valid())
+			TEST_CHECK(lhs.get_index(lhs_base.m_predecessor) == rhs.get_index(rhs_base.m_predecessor));
+		if(lhs_base.m_successor.is_valid())
+			TEST_CHECK(lhs.get_index(lhs_base.m_successor) == rhs.get_index(rhs_base.m_successor));
+	}
+
+	return true;
+}
+
+
+//=================================================================================================
+// Elements added in a batch end up where they would be without one, also if they are added to
+// nested parents whose subtrees end at the same index or to elements queued in the same batch
+//=================================================================================================
+static bool batch_matches_single_adds()
+{
+	SpatialCatalog batched(red::vector2f(800, 600));
+	SpatialCatalog single(red::vector2f(800, 600));
+
+	std::vector<SpatialCatalog::HandleType> batched_handles, single_handles;
+	batched_handles.push_back(SpatialCatalog::HandleType());
+	single_handles.push_back(SpatialCatalog::HandleType());
+
+	// A random forest, the first part of it is committed before the batch begins
+	unsigned random = 12345;
+	size_t const num = 2000;
+	for(size_t i = 0; i < num; ++i)
+	{
+		if(i == 500)
+			batched.begin_batch();
+
+		random = random * 1103515245 + 12345;
+		size_t const parent = (random >> 8) % batched_handles.size();
+		red::vector2f const pos(float(i), 0.0f);
+
+		batched_handles.push_back(batched.add(batched_handles[parent], pos, red::vector2f(1, 1)));
+		single_handles.push_back(single.add(single_handles[parent], pos, red::vector2f(1, 1)));
+
+		TEST_CHECK(batched.last_child(batched_handles[parent]) == batched_handles.back());
+		if(parent)
+			TEST_CHECK(batched.has_children(batched_handles[parent]));
+	}
+
+	// Handles can be used before the batch is committed
+	TEST_CHECK(batched.get<SpatialCatalog::Position>(batched_handles[1500]).m_position.x() == 1499.0f);
+
+	TEST_CHECK(!batched.commit_batch().empty());
+	TEST_CHECK(!batched.batching());
+	TEST_CHECK(same_layout(batched, single, num));
+
+	for(size_t i = 1; i < batched_handles.size(); ++i)
+		TEST_CHECK(batched.get<SpatialCatalog::Position>(batched_handles[i]).m_position.x() == float(i - 1));
+
+	batched.update();
+	single.update();
+	for(size_t i = 0; i < num; ++i)
+		TEST_CHECK(batched.at<SpatialCatalog::ZData>(i).m_world_z_index == single.at<SpatialCatalog::ZData>(i).m_world_z_index);
+
+	return true;
+}
+
+
+//=================================================================================================
+// Nothing may move elements while a batch is open, and a batch that only appends leaves the
+// elements where they are
+//=================================================================================================
+static bool batch_guards()
+{
+	SpatialCatalog spatials(red::vector2f(800, 600));
+
+	TEST_CHECK(spatials.commit_batch().empty());
+
+	spatials.begin_batch();
+	auto root = spatials.add(SpatialCatalog::HandleType(), red::vector2f(), red::vector2f(100, 100));
+	auto child = spatials.add(root, red::vector2f(), red::vector2f(10, 10));
+	TEST_CHECK(spatials.first_child(root) == child);
+
+	bool thrown = false;
+	try { spatials.update(); } catch(light::runtime_error const &) { thrown = true; }
+	TEST_CHECK(thrown);
+
+	thrown = false;
+	try { spatials.remove(child); } catch(light::runtime_error const &) { thrown = true; }
+	TEST_CHECK(thrown);
+
+	thrown = false;
+	try { spatials.compact(); } catch(light::runtime_error const &) { thrown = true; }
+	TEST_CHECK(thrown);
+
+	// Elements added in depth-first order are appended in place already
+	TEST_CHECK(spatials.commit_batch().empty());
+	TEST_CHECK(spatials.get_index(child) == 1);
+
+	spatials.remove(child);
+	spatials.compact();
+	spatials.update();
+	TEST_CHECK(!spatials.has_children(root));
+
+	return true;
+}
+
+
+int main()
+{
+	bool ok = remove_then_add_before_update();
+	ok = batch_matches_single_adds() && ok;
+	ok = batch_guards() && ok;
+	if(!ok)
+		return 1;
+
+	std::puts("spatial_catalog_test: ok");
+	return 0;
+}